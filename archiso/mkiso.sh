@@ -4,7 +4,8 @@
 cp ../build/ali default/airootfs/root/ali
 # note: permissions to execute ali are set in profiledef.sh
 
-cp -r ../profiles default/airootfs/root/ali/
+# profiles are compiled into ali. To override without rebuilding, copy
+# the profiles directory to default/airootfs/etc/ali/profiles
 
 # -v verbose
 # -r remove working directory when done
@@ -0,0 +1,56 @@
+#ifndef ALI_COMMANDGROUPS_H
+#define ALI_COMMANDGROUPS_H
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ali/common.hpp>
+#include <ali/profiles.hpp>
+
+
+struct CommandResult
+{
+  std::string group;
+  std::string command;
+  int exit_code{-1};  // -1 if the command did not run
+  std::chrono::milliseconds duration{0};
+};
+
+
+// Runs command groups in a single chroot. Each group is written to a script which is run
+// by a master script: groups that can run concurrently are started in the background, 
+// then waited on. Each command's exit code and duration are reported by a marker line.
+class CommandGroupRunner
+{
+public:
+  using Log = std::function<void(const std::string_view)>;
+
+  // Groups which run at the same time. A group that isn't parallel is alone in its wave.
+  using Waves = std::vector<std::vector<std::size_t>>;
+
+  CommandGroupRunner(const fs::path& root, const std::string_view user, Log&& info, Log&& warning);
+
+  // Returns false if the groups are invalid or the chroot failed. A failing
+  // command is not an error, see results().
+  bool run(const std::vector<CommandGroup>& groups);
+
+  const std::vector<CommandResult>& results() const { return m_results; }
+  
+  // Empty if a group's 'after' is unknown or there is a cycle
+  static std::optional<Waves> plan(const std::vector<CommandGroup>& groups);
+
+private:
+  bool write_scripts(const std::vector<CommandGroup>& groups, const Waves& waves);
+  void on_output(const std::string_view line);
+
+private:
+  fs::path m_root;
+  std::string m_user;
+  Log m_info, m_warning;
+  std::vector<CommandResult> m_results; // in same order as written to scripts
+};
+
+#endif
@@ -1,15 +1,24 @@
 #ifndef ALI_COMMANDS_H
 #define ALI_COMMANDS_H
 
+#include <chrono>
 #include <string>
 #include <string_view>
 #include <functional>
 #include <format>
+#include <stop_token>
+#include <sys/types.h>
 #include <ali/disk_utils.hpp>
 #include <ali/common.hpp>
 
 inline const int CmdSuccess = 0;
 inline const int CmdFail = -1;
+inline const int CmdCancelled = -2; // stop requested
+inline const int CmdTimeout = -3;   // deadline reached, or no output for the stall limit
+
+// pacman has no output while a download stalls or a hook runs, long enough
+// for a slow hook but a hung pacman is terminated
+inline constexpr std::chrono::minutes PacmanStallLimit {10};
 
 using OutputHandler = std::function<void(const std::string_view)>;
 
@@ -42,6 +51,16 @@ struct Command
 
   int get_result() const { return m_result; }
 
+  // Limits for execute(), zero is unlimited. The deadline is the total time, the stall
+  // limit is the time without output. When reached, the command's process group is terminated.
+  void set_limits(const std::chrono::seconds deadline, const std::chrono::seconds stall = std::chrono::seconds{0});
+
+  // Commands executed on this thread are terminated when a stop is requested. A thread
+  // started to run commands for another should set that thread's token.
+  static void set_stop_token(std::stop_token token);
+  static std::stop_token get_stop_token();
+  static bool stop_requested();
+
 protected:
   bool executed() const { return m_executed; }
   bool start_write(const std::string_view cmd);
@@ -49,6 +68,8 @@ protected:
 
 private:
   int close();
+  int wait(const pid_t pid, const std::chrono::steady_clock::time_point start);
+  bool limit_reached(const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point last_output, int& reason) const;
 
 private:
   std::string m_cmd;
@@ -56,6 +77,8 @@ private:
   bool m_executed{false};
   int m_result{CmdSuccess};
   FILE * m_fd{nullptr};
+  std::chrono::seconds m_deadline{0};
+  std::chrono::seconds m_stall{0};
 };
 
 
@@ -68,18 +91,18 @@ private:
 struct ChRootCmd : public Command
 {
 private:
-  static std::string create_cmd(const std::string_view cmd)
+  static std::string create_cmd(const fs::path& root, const std::string_view cmd)
   {
-    return std::format("arch-chroot {} {}", RootMnt.string(), cmd) ;
+    return std::format("arch-chroot {} {}", root.string(), cmd) ;
   }
 
-  static std::string create_shell_cmd(const std::string_view cmd)
+  static std::string create_shell_cmd(const fs::path& root, const std::string_view cmd)
   {
-    return create_shell_cmd({QString::fromLocal8Bit(cmd.data(), cmd.size())}) ;
+    return create_shell_cmd(root, {QString::fromLocal8Bit(cmd.data(), cmd.size())}) ;
   }
 
 
-  static std::string create_shell_cmd(const QStringList& cmds, const std::string_view user = "")
+  static std::string create_shell_cmd(const fs::path& root, const QStringList& cmds, const std::string_view user = "")
   {
     std::stringstream ss;
     ss << "(";
@@ -93,7 +116,7 @@ private:
     for (const auto& cmd : cmds)
       ss << std::format(R"!(echo "{}"; )!", cmd.toStdString());
 
-    ss << " exit;) | arch-chroot " << RootMnt.string();
+    ss << " exit;) | arch-chroot " << root.string();
 
     const auto cmd_string = ss.str();
 
@@ -103,20 +126,22 @@ private:
 
 
 public:
-  ChRootCmd(const std::string_view cmd, const bool launch_shell = false) : Command(launch_shell ? create_shell_cmd(cmd) : create_cmd(cmd))
+  // root: the installed system's root, i.e. /mnt
+  ChRootCmd(const fs::path& root, const std::string_view cmd, const bool launch_shell = false) :
+    Command(launch_shell ? create_shell_cmd(root, cmd) : create_cmd(root, cmd))
   {
 
   }
 
-  ChRootCmd(const std::string_view cmd, std::function<void(const std::string_view)>&& on_output, const bool launch_shell = false) :
-    Command(launch_shell ? create_shell_cmd(cmd) : create_cmd(cmd), std::move(on_output))
+  ChRootCmd(const fs::path& root, const std::string_view cmd, std::function<void(const std::string_view)>&& on_output, const bool launch_shell = false) :
+    Command(launch_shell ? create_shell_cmd(root, cmd) : create_cmd(root, cmd), std::move(on_output))
   {
 
   }
 
   // run commands are user: when user is set, when entering chroot, we `su {user}` before
   // executing commands. If running at root, leave `user` empty.
-  ChRootCmd(const QStringList& cmds, const std::string_view user = "") : Command(create_shell_cmd(cmds, user))
+  ChRootCmd(const fs::path& root, const QStringList& cmds, const std::string_view user = "") : Command(create_shell_cmd(root, cmds, user))
   {
 
   }
@@ -202,6 +227,28 @@ struct SysClockSync : public Command
 };
 
 
+// Download the first 'bytes' of url, discarding the data
+struct DownloadSpeed : public Command
+{
+  DownloadSpeed(const std::string_view url, const uint64_t bytes = 4 * 1024 * 1024, const int timeout_secs = 10);
+
+  // average bytes per second, 0 if failed
+  uint64_t get_speed();
+  // seconds until first byte, only valid after get_speed()
+  double get_latency() const { return m_latency; }
+
+private:
+  uint64_t m_speed{0};
+  double m_latency{0};
+};
+
+
+struct PacmanSyncDb : public Command
+{
+  PacmanSyncDb() : Command("pacman -Sy --noconfirm") {}
+};
+
+
 struct VideoVendor : public Command
 {
   VideoVendor();
@@ -219,8 +266,8 @@ private:
 struct GetShellPath : public ChRootCmd
 {
   // TODO or use: pacman -Qo <shell>
-  GetShellPath(const std::string_view shell_name) :
-    ChRootCmd(std::format("chsh -l"), std::bind_front(&GetShellPath::on_output, std::ref(*this))),
+  GetShellPath(const fs::path& root, const std::string_view shell_name) :
+    ChRootCmd(root, std::format("chsh -l"), std::bind_front(&GetShellPath::on_output, std::ref(*this))),
     m_shell_name(shell_name)
   {
 
@@ -258,7 +305,7 @@ private:
 
 struct SetShell : public ChRootCmd
 {
-  SetShell(const fs::path path, const std::string_view user) : ChRootCmd(std::format("chsh -s {} {}", path.string(), user))
+  SetShell(const fs::path& root, const fs::path path, const std::string_view user) : ChRootCmd(root, std::format("chsh -s {} {}", path.string(), user))
   {
 
   }
@@ -266,32 +313,60 @@ struct SetShell : public ChRootCmd
 
 
 // Filesystems
+// Each FS struct has the mkfs type and an argument set per device class:
+//  - hdd: rotational
+//  - ssd: non-rotational (SATA or NVMe) which has been discarded by blkdiscard
+//         before mkfs, so mkfs doesn't need to discard again
+//  - other: unknown class, or non-rotational without discard support
 template<class FS>
 struct CreateFilesystem : public Command
 {
-  CreateFilesystem(const std::string_view dev) : Command(std::format("mkfs.{} {}", FS::cmd, dev))
+  CreateFilesystem(const std::string_view dev, const DeviceClass dev_class = DeviceClass::Unknown, const bool discarded = false)
+    : Command(create_cmd(dev, dev_class, discarded))
   {
-    qDebug() << std::format("mkfs.{} {}", FS::cmd, dev);
+    qDebug() << create_cmd(dev, dev_class, discarded);
   }
 
 private:
-  std::string dev;
+  static std::string create_cmd(const std::string_view dev, const DeviceClass dev_class, const bool discarded)
+  {
+    std::string_view opts = FS::other_opts;
+
+    if (dev_class == DeviceClass::Hdd)
+      opts = FS::hdd_opts;
+    else if (discarded && (dev_class == DeviceClass::Ssd || dev_class == DeviceClass::Nvme))
+      opts = FS::ssd_opts;
+
+    return opts.empty() ? std::format("mkfs.{} {}", FS::cmd, dev) : std::format("mkfs.{} {} {}", FS::cmd, opts, dev);
+  }
 };
 
 
 struct Ext4
 {
   static constexpr char cmd[] = "ext4";
+  // inode tables are initialised by the kernel after first mount, rather
+  // than mkfs writing them all (which is slow on large disks)
+  static constexpr char hdd_opts[] = "-E lazy_itable_init=1";
+  // already discarded so skip mkfs's discard pass
+  static constexpr char ssd_opts[] = "-E nodiscard,lazy_itable_init=1";
+  static constexpr char other_opts[] = "";
 };
 
 struct BtrFs
 {
   static constexpr char cmd[] = "btrfs";
+  static constexpr char hdd_opts[] = "";
+  static constexpr char ssd_opts[] = "--nodiscard";
+  static constexpr char other_opts[] = "";
 };
 
 struct Fat32
 {
   static constexpr char cmd[] = "vfat -F 32";
+  static constexpr char hdd_opts[] = "";
+  static constexpr char ssd_opts[] = "";
+  static constexpr char other_opts[] = "";
 };
 
 using CreateExt4 = CreateFilesystem<Ext4>;
@@ -310,42 +385,67 @@ struct CreateBtrVolume : public Command
 };
 
 
-// set partition type
-template<class T>
-struct SetPartitionType : public Command
+struct SnapshotBtrVolume : public Command
 {
-  SetPartitionType(const int part_num, const std::string_view parent_dev)
-    : Command(std::format("sgdisk -t{}:{} {}", part_num, T::hex, parent_dev))
+  SnapshotBtrVolume(const fs::path src, const fs::path dest)
+    : Command(std::format("btrfs subvolume snapshot {} {}", src.string(), dest.string()))
   {
-    qDebug() << std::format("sgdisk -t{}:{} {}", part_num, T::hex, parent_dev);
+    qDebug() << std::format("btrfs subvolume snapshot {} {}", src.string(), dest.string());
   }
 };
 
-// Hex codes taken from: https://gist.github.com/gotbletu/a05afe8a76d0d0e8ec6659e9194110d2
-struct EfiType
+
+struct DeleteBtrVolume : public Command
 {
-  static constexpr char hex[] = "ef00";
+  DeleteBtrVolume(const fs::path path)
+    : Command(std::format("btrfs subvolume delete {}", path.string()))
+  {
+    qDebug() << std::format("btrfs subvolume delete {}", path.string());
+  }
 };
 
-struct LinuxRootType
+
+struct ReadOnlyBtrVolume : public Command
+{
+  ReadOnlyBtrVolume(const fs::path path)
+    : Command(std::format("btrfs property set -ts {} ro true", path.string()))
+  {
+    qDebug() << std::format("btrfs property set -ts {} ro true", path.string());
+  }
+};
+
+
+// --compressed-data sends extents as they're compressed on disk (requires protocol 2, --proto 0 is latest)
+struct SendBtrVolume : public Command
 {
-  static constexpr char hex[] = "8304";
+  SendBtrVolume(const fs::path subvolume, const fs::path stream)
+    : Command(std::format("btrfs send --proto 0 --compressed-data -f {} {}", stream.string(), subvolume.string()))
+  {
+    qDebug() << std::format("btrfs send --proto 0 --compressed-data -f {} {}", stream.string(), subvolume.string());
+  }
 };
 
-struct LinuxHomeType
+
+// the received subvolume is read-only, with the name it was sent with
+struct ReceiveBtrVolume : public Command
 {
-  static constexpr char hex[] = "8302";
+  ReceiveBtrVolume(const fs::path stream, const fs::path dest)
+    : Command(std::format("btrfs receive -f {} {}", stream.string(), dest.string()))
+  {
+    qDebug() << std::format("btrfs receive -f {} {}", stream.string(), dest.string());
+  }
 };
 
-// Not used yet
-// struct LinuxSwapType
-// {
-//   static constexpr char hex[] = "8200";
-// };
 
-using SetPartitionAsEfi = SetPartitionType<EfiType>;
-using SetPartitionAsLinuxRoot = SetPartitionType<LinuxRootType>;
-using SetPartitionAsLinuxHome = SetPartitionType<LinuxHomeType>;
+// Discard all blocks on a device/partition. This is quicker for mkfs to do on SSD/NVMe, and
+// informs the drive that all blocks are free. -f because wipefs may leave signatures
+struct DiscardDevice : public Command
+{
+  DiscardDevice(const std::string_view dev) : Command(std::format("blkdiscard -f {}", dev))
+  {
+    qDebug() << std::format("blkdiscard -f {}", dev);
+  }
+};
 
 
 #endif
@@ -2,6 +2,11 @@
 #define ALI_COMMON_H
 
 #include <filesystem>
+#include <format>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
 
 namespace fs = std::filesystem;
 
@@ -25,4 +30,19 @@ enum class CpuVendor
 };
 
 
+
+inline std::string format_size(const int64_t size)
+{
+  static const char *sizeNames[] = {"B", "KB", "MB", "GB", "TB", "PB"};
+
+  if (size <= 0)
+    return "0 B";
+
+  const uint64_t i = std::min<uint64_t>((uint64_t) std::floor(std::log(size) / std::log(1024)), 5);
+  const auto display_size = size / std::pow(1024, i);
+  
+  return std::format("{:.1f} {}", display_size, sizeNames[i]);
+}
+
+
 #endif
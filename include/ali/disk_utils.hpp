@@ -4,16 +4,15 @@
 #include <vector>
 #include <string>
 #include <string_view>
+#include <format>
+#include <optional>
+#include <shared_mutex>
 #include <fstream>
 #include <QDebug>
 #include <ali/common.hpp>
 
 
-extern const fs::path HomeMnt;
-//extern const fs::path BootMnt;
 extern const fs::path RootMnt;
-extern const fs::path EfiMnt;
-extern const fs::path FsTabPath;
 
 
 // partitions, mounting, filesystems
@@ -28,14 +27,88 @@ enum class PartitionStatus
 };
 
 
+// Storage class of the disk a partition is on. Read from sysfs
+// for the parent device, used to tune mkfs and mount options.
+enum class DeviceClass
+{
+  Unknown,
+  Hdd,    // rotational
+  Ssd,    // non-rotational SATA/SAS/USB
+  Nvme    // non-rotational NVMe
+};
+
+
+inline const char * device_class_name(const DeviceClass c)
+{
+  switch (c)
+  {
+    using enum DeviceClass;
+    case Hdd:   return "HDD";
+    case Ssd:   return "SSD";
+    case Nvme:  return "NVMe";
+    default:    return "Unknown";
+  }
+}
+
+
+// Mount options for btrfs, used at install time and copied to fstab.
+//  - compress: zstd level 1 to 15, 0 disables compression
+//  - noatime: don't write access times. A VFS flag rather than a btrfs option, which
+//    Install::do_mount passes as MS_NOATIME
+//  - space_cache=v2: free space tree (default in newer kernels, but explicit)
+//  - ssd and discard=async: only if device is SSD/NVMe (and supports discard)
+//  - discard=async also if thin provisioned (a VM's disk), which is reported as HDD
+struct BtrfsMountProfile
+{
+  static constexpr int MaxZstdLevel = 15;
+
+  int zstd_level{3};
+  bool noatime{true};
+
+  std::string options(const std::string_view subvol, const DeviceClass dev_class, const bool can_discard, const bool thin_provisioned = false) const
+  {
+    std::string opts = std::format("subvol={}", subvol);
+
+    if (zstd_level > 0)
+      opts += std::format(",compress=zstd:{}", std::min(zstd_level, MaxZstdLevel));
+
+    if (noatime)
+      opts += ",noatime";
+
+    opts += ",space_cache=v2";
+
+    if (dev_class == DeviceClass::Ssd || dev_class == DeviceClass::Nvme)
+    {
+      opts += ",ssd";
+
+      if (can_discard)
+        opts += ",discard=async";
+    }
+    else if (thin_provisioned && can_discard)
+      opts += ",discard=async";
+
+    return opts;
+  }
+
+  std::string summary() const
+  {
+    return std::format("{}{}", zstd_level > 0 ? std::format("zstd:{}", zstd_level) : "no compression",
+                               noatime ? ", noatime" : "");
+  }
+};
+
+
 struct Partition
 {
   std::string dev;        // /dev/sda1, /dev/nvmen1p3, etc
   std::string parent_dev; // /dev/sda, /dev/nvmen1, etc
   std::string fs_type;    // ext4, vfat, etc
   std::string type_uuid;  // partition type UUID (useful to identify EFI)
+  std::string uuid;       // filesystem UUID, changes when filesystem is created
   int64_t size{0};        // partition/filesystem size  
   int part_number{0};     // partition number
+  DeviceClass dev_class{DeviceClass::Unknown}; // class of parent device
+  bool can_discard{false};  // parent device supports discard (TRIM)
   bool is_efi{false};     // if part type UUID is for EFI
   bool is_fat32{false};   // if fs_type is VFAT and version is FAT32
   bool is_gpt{false};     // if partition table is GPT
@@ -49,16 +122,30 @@ inline QDebug operator<<(QDebug q, const Partition& p)
   q << '\t' << "Filesystem: " << p.fs_type << '\n';
   q << '\t' << "Size: " << p.size << '\n';  
   q << '\t' << "Part Type UUID: " << p.type_uuid << '\n';
+  q << '\t' << "UUID: " << p.uuid << '\n';
   q << '\t' << "Part Num: " << p.part_number << '\n';
   q << '\t' << "EFI: " << p.is_efi << '\n';
   q << '\t' << "FAT32: " << p.is_fat32 << '\n';
-  q << '\t' << "GPT: " << p.is_gpt ;
+  q << '\t' << "GPT: " << p.is_gpt << '\n';
+  q << '\t' << "Device Class: " << device_class_name(p.dev_class) << '\n';
+  q << '\t' << "Discard: " << p.can_discard ;
   return q;
 }
 
 using Partitions = std::vector<Partition>;
 
 
+// A whole disk without a partition table or filesystem
+struct BlankDisk
+{
+  std::string dev;  // /dev/sda, /dev/nvme0n1, etc
+  uint64_t size{0}; // bytes
+  DeviceClass dev_class{DeviceClass::Unknown};
+};
+
+using BlankDisks = std::vector<BlankDisk>;
+
+
 enum class ProbeOpts
 {
   All,
@@ -86,29 +173,44 @@ public:
   }
   
   
-  static const Partitions& partitions() { return m_parts; }
-  static std::size_t num_partitions() { return m_parts.size(); }
-  static bool have_partitions() { return !m_parts.empty(); }
+  // Probe a partition again, i.e. after creating a filesystem. Returns false if
+  // the partition was not in the previous probe results
+  static bool refresh_partition(const std::string_view dev);
+
+  // copies: concurrent installs refresh partitions while others read them
+  static Partitions partitions() { std::shared_lock lock{m_mutex}; return m_parts; }
+  static std::size_t num_partitions() { std::shared_lock lock{m_mutex}; return m_parts.size(); }
+  static bool have_partitions() { std::shared_lock lock{m_mutex}; return !m_parts.empty(); }
 
   static std::string get_partition_fs (const std::string_view dev);
   static int get_partition_part_number (const std::string_view dev);
+  static int64_t get_partition_size (const std::string_view dev);
   static std::string get_partition_parent (const std::string_view dev);
+  static std::string get_partition_uuid (const std::string_view dev);
+  static DeviceClass get_partition_device_class (const std::string_view dev);
+  static bool get_partition_can_discard (const std::string_view dev);
 
   static bool is_path_mounted(const std::string_view path);
   static bool is_dev_mounted(const std::string_view path);
 
+  // Physical disks that have no partition table and no filesystem, which the
+  // Partitioner can use. Independent of probe results.
+  static BlankDisks blank_disks();
+
 private:
   using Tree = std::map<std::string, std::vector<std::string>>;
 
   static bool do_probe(const ProbeOpts opts, const bool gpt_only);
   static Tree create_tree();
+  static std::tuple<DeviceClass, bool> read_device_class(const std::string_view disk);
 
   static std::tuple<PartitionStatus, Partition> probe_partition(const std::string_view part_dev);
-  static std::optional<std::reference_wrapper<const Partition>> get_partition(const std::string_view dev);
+  static std::optional<Partition> get_partition(const std::string_view dev);
   
   static bool is_mounted(const std::string_view path_or_dev, const bool is_dev);
 
 private:
+  inline static std::shared_mutex m_mutex;
   static Partitions m_parts;
 };
 
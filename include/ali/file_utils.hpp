@@ -0,0 +1,18 @@
+#ifndef ALI_FILEUTILS_H
+#define ALI_FILEUTILS_H
+
+#include <string_view>
+#include <ali/common.hpp>
+
+
+class FileUtils
+{
+public:
+  // Write content to a temporary file in the same directory, fsync, then rename
+  // over path. Readers see either the old or new file, never partial content.
+  static bool write_atomic(const fs::path& path, const std::string_view content,
+                           const fs::perms perms = fs::perms::owner_read | fs::perms::owner_write |
+                                                   fs::perms::group_read | fs::perms::others_read);
+};
+
+#endif
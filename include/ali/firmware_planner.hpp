@@ -0,0 +1,48 @@
+#ifndef ALI_FIRMWAREPLANNER_H
+#define ALI_FIRMWAREPLANNER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <QStringList>
+#include <ali/common.hpp>
+
+
+struct FirmwarePlan
+{
+  QStringList packages;     // split linux-firmware-* packages, or "linux-firmware" if detection failed
+  std::string hypervisor;   // not empty if a VM, then no firmware is required
+  std::size_t n_modules{0}; // device drivers which load firmware
+  bool detected{false};     // false if the devices or firmware couldn't be determined
+
+  std::string summary() const;
+};
+
+
+// linux-firmware is split by vendor (linux-firmware-intel, linux-firmware-amdgpu, etc).
+// Rather than install all of them, only those with firmware for the PCI and USB
+// devices are installed:
+//  - each device's driver module, from sysfs, or its modalias if no driver is bound
+//  - the firmware files each module can load, from `modinfo -F firmware`
+//  - the package with each firmware file, from the live system's packages, or by
+//    the file's directory if the live system doesn't have the split packages
+//
+// VMs don't require firmware (except with passthrough, which can be fixed after).
+class FirmwarePlanner
+{
+public:
+  static constexpr char FullPackage[] = "linux-firmware";
+
+  static FirmwarePlan plan();
+
+private:
+  // firmware path, relative to FirmwareDir and without a compression extension -> package
+  using FileOwners = std::map<std::string, std::string, std::less<>>;
+
+  static std::set<std::string> device_modules();
+  static std::set<std::string> module_firmware(const std::set<std::string>& modules);
+  static FileOwners live_file_owners();
+  static std::string package_for(const std::string_view file, const FileOwners& owners);
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef ALI_FSTAB_H
+#define ALI_FSTAB_H
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ali/common.hpp>
+
+
+// Options policy per filesystem type:
+//  - remove: options which are removed from those in the mount table
+//  - append: options added if not already present
+//  - pass: fsck order, root is always 1 unless pass is 0 for the fs
+struct FsTabPolicy
+{
+  std::string_view fs;
+  std::vector<std::string_view> remove;
+  std::vector<std::string_view> append;
+  int pass{2};
+};
+
+
+// Creates fstab from the filesystems mounted under a root (i.e. /mnt), replacing
+// `genfstab -U`. The mount table is read with libmount and the source is identified
+// by UUID, taken from PartitionUtils' probe data.
+class FsTab
+{
+public:
+  struct Entry
+  {
+    std::string source;   // /dev/sda1
+    std::string uuid;
+    std::string target;   // relative to the installed root, i.e. /efi
+    std::string fs;
+    std::string options;
+    int dump{0};
+    int pass{0};
+  };
+
+  // installed mount point (i.e. /efi) -> options it was mounted with only for the install
+  using SessionOptions = std::map<std::string, std::vector<std::string>, std::less<>>;
+
+  // exclude: mount points under root not written, i.e. a bind mounted package cache
+  // session: options removed from the mount point's entry
+  static bool write(const fs::path& root, const fs::path& fstab_path, const std::vector<fs::path>& exclude = {},
+                    const SessionOptions& session = {});
+
+  static std::vector<Entry> read_mounts(const fs::path& root);
+
+private:
+  static const FsTabPolicy& get_policy(const std::string_view fs);
+  static std::string apply_policy(const FsTabPolicy& policy, const std::string_view options);
+  static std::string create_content(const std::vector<Entry>& entries);
+};
+
+#endif
@@ -5,7 +5,15 @@
 #include <QString>
 #include <QObject>
 #include <ali/commands.hpp>
+#include <ali/fstab.hpp>
 #include <ali/packages.hpp>
+#include <ali/partitioner.hpp>
+#include <ali/profiles.hpp>
+#include <ali/install_target.hpp>
+#include <ali/stage_journal.hpp>
+#include <ali/widgets/partitions_widget.hpp>
+
+class SharedInstall;
 
 
 enum class CompleteStatus
@@ -16,6 +24,14 @@ enum class CompleteStatus
   ExtraSuccess
 };
 
+enum class InstallMode
+{
+  Full,     // install packages and profile
+  Capture,  // as Full, then capture the result to an image
+  Deploy,   // deploy an image, then only the per machine stages
+  Resume    // continue a failed install from its journal, in the journal's mode
+};
+
 class Install : public QObject
 {
   Q_OBJECT
@@ -24,7 +40,11 @@ public:
   Install() = default;
   virtual ~Install() = default;
 
-  void install ();
+  // shared: when installing several targets concurrently, otherwise nullptr
+  void install (const InstallTarget& target, const MountData& mounts, const InstallMode mode = InstallMode::Full,
+                const fs::path& image_dir = {}, SharedInstall * shared = nullptr);
+
+  const InstallTarget& target() const { return m_target; }
 
 signals:
   void on_stage_start(const QString stage);
@@ -44,35 +64,68 @@ private:
   void log_critical(const std::string_view msg);
   void log_stage_start(const std::string_view msg);
   void log_stage_end(const std::string_view msg);
+  std::string with_target(const std::string_view msg) const;
     
   bool filesystems();  
   bool wipe_fs(const std::string_view dev);
-  bool create_filesystem(const std::string_view part_dev, const std::string_view fs);
-  bool create_btrfs_filesystem(const std::string_view part_dev, const fs::path mount, const MountType type);
+  bool discard(const std::string_view dev);
+  bool create_filesystem(const std::string_view part_dev, const std::string_view fs, const bool discarded);
+  bool create_btrfs_filesystem(const std::string_view part_dev, const fs::path mount, const MountType type, const bool discarded);
   bool create_btrfs_subvolume(const std::string_view part_dev, const fs::path mount, const std::string_view subvolume);
+  bool receive_btrfs_root(const std::string_view part_dev, const fs::path mount);
 
   // TODO not convinced I like this
-  template<class Cmd>
-  void set_partition_type(const std::string_view part_dev)
+  // Failing to set the type is not an error, but the result is logged per partition
+  template<class Type>
+  bool set_partition_type(const std::string_view part_dev)
   {
     const int part_num =  PartitionUtils::get_partition_part_number(part_dev);
     const std::string parent_dev = PartitionUtils::get_partition_parent(part_dev);
 
     if (!part_num || parent_dev.empty())
     {
-      log_warning("Cannot get parent device and/or partition number, cannot set partition type. Not an error");
+      log_warning(std::format("Cannot get parent device and/or partition number for {}, cannot set partition type. Not an error", part_dev));
+      return false;
+    }
+    else if (!Partitioner::set_type<Type>(parent_dev, part_num))
+    {
+      log_warning(std::format("Failed to set partition type for {}. This is not an error.", part_dev));
+      return false;
     }
     else
     {
-      if (Cmd cmd{part_num, parent_dev}; cmd.execute() != CmdSuccess)
-        log_warning(std::format("Failed to set partition type for {}. This is not an error.", part_dev));
+      log_info(std::format("Set partition type for {} (partition {} on {})", part_dev, part_num, parent_dev));
+      return true;
     }
   }
   
-
   bool mount();
-  bool do_mount(const std::string_view dev, const std::string_view path, const std::string_view fs, const std::string_view options = {});
+  bool resume_journal();
+  void begin_journal();
+  StageJournal::Inputs journal_inputs() const;
+  std::string stage_inputs(const std::string_view stage) const;
+  PackageSet stage_packages(const std::string_view stage) const;
+  bool packages_installed(const PackageSet& packages);
+  bool sync_target();
+  bool end_session();
+  bool verify_boot();
+  void cancelled();
+  bool capture_image();
+  bool deploy_image();
+  bool do_mount(const std::string_view dev, const std::string_view path, const std::string_view fs, const std::string_view options = {},
+                const unsigned long flags = 0);
+  void share_cache(const bool mounted);
+  void prepare_live();
+  void vm_initramfs();
+  void initramfs_compression();
+  void defer_hooks();
+  bool pacman_hooks();
+  bool virtual_machine();
   bool pacman_strap();
+  void apply_mirrors(const fs::path& mirrorlist);
+  void configure_pacman(const fs::path& conf);
+  void build_config();
+  void log_btrfs_usage(const BtrfsMountProfile& profile);
   bool swap();
   bool fstab();
   
@@ -84,6 +137,7 @@ private:
   bool shell();
 
   bool boot_loader();
+  bool grub_config();
   bool prepare_grub_probe();
   void cleanup_grub_probe();
   
@@ -94,8 +148,7 @@ private:
   bool gpu();
   
   bool profile();
-  void run_user_commands(const QStringList& commands);
-  void run_sys_commands(const QStringList& commands);
+  void run_command_groups(const std::vector<CommandGroup>& profile_groups);
 
   bool packages();
 
@@ -104,6 +157,20 @@ private:
   bool copy_files(const fs::path& src, const fs::path& dest, const std::vector<std::string_view>& extensions);
   bool pacman_install(const PackageSet& packages);
   bool pacman_install(const QStringList& packages);
+
+private:
+  InstallTarget m_target{InstallTarget::single()};
+  MountData m_mounts;
+  SharedInstall * m_shared{nullptr};
+  bool m_shared_arrived{false};
+  fs::path m_cache_bind;  // the shared package cache, bind mounted in this target
+  std::vector<std::string> m_temp_mounts; // for os-prober
+  InstallMode m_mode{InstallMode::Full};
+  fs::path m_image_dir;
+  bool m_root_received{false}; // root subvolume received from the image's btrfs send stream
+  StageJournal m_journal;
+  bool m_hooks_deferred{false}; // expensive pacman hooks run once, after all packages are installed
+  FsTab::SessionOptions m_session_options;
 };
 
 #endif
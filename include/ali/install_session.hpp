@@ -0,0 +1,48 @@
+#ifndef ALI_INSTALLSESSION_H
+#define ALI_INSTALLSESSION_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/mount.h>
+#include <ali/common.hpp>
+
+
+// For the duration of an install, speed is preferred over durability because a crash
+// mid-install means reinstalling (or resuming):
+//  - the CPU governor is performance
+//  - target filesystems are mounted noatime and lazytime, and ext4 and btrfs without write
+//    barriers, so the fsyncs of pacman and the hooks don't flush the disk's cache
+// When the install ends, barriers are restored and each filesystem is synced once.
+//
+// Concurrent installs share the session: the first to start sets the governor, the last
+// to end restores it.
+class InstallSession
+{
+public:
+  static constexpr unsigned long MountFlags = MS_NOATIME | MS_LAZYTIME;
+
+  InstallSession();
+  ~InstallSession();
+
+  // the options to mount with, the persistent options plus the session's
+  static std::string mount_options(const std::string_view fs, const std::string_view persistent);
+
+  // the options only for the session, which are not written to fstab
+  static std::vector<std::string> session_options(const std::string_view fs, const std::string_view persistent);
+
+  // restore barriers, so the sync flushes the disk's cache
+  static bool end_mount(const std::string_view dev, const fs::path& path, const std::string_view fs);
+
+private:
+  static bool has_barrier_option(const std::string_view fs);
+
+private:
+  inline static std::mutex m_mutex;
+  inline static int m_count{0};
+  inline static std::map<fs::path, std::string> m_governors; // cpufreq policy -> governor before the session
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef ALI_INSTALLTARGET_H
+#define ALI_INSTALLTARGET_H
+
+#include <string>
+#include <ali/common.hpp>
+#include <ali/disk_utils.hpp>
+
+
+// Where a target's root is mounted. A single install uses RootMnt (/mnt). When
+// installing to several targets concurrently, each is at /mnt/ali/<n>, so no
+// target is mounted within another.
+struct InstallTarget
+{
+  inline static const fs::path MultiMnt {"/mnt/ali"};
+
+  int index{0}; // 0 for a single install, otherwise from 1
+  fs::path root;
+
+  fs::path efi() const { return root / "efi"; }
+  fs::path home() const { return root / "home"; }
+  fs::path fstab() const { return root / "etc/fstab"; }
+
+  // a path within the target, i.e. path("etc/hostname") is /mnt/etc/hostname
+  fs::path path(const fs::path& p) const { return root / p.relative_path(); }
+
+  bool is_multi() const { return index != 0; }
+  std::string name() const { return is_multi() ? std::format("Target {}", index) : root.string(); }
+
+  static InstallTarget single() { return InstallTarget{.index = 0, .root = RootMnt}; }
+  static InstallTarget multi(const int n) { return InstallTarget{.index = n, .root = MultiMnt / std::to_string(n)}; }
+};
+
+#endif
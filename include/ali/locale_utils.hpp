@@ -40,12 +40,13 @@ public:
   static const QStringList& get_keymaps() { return m_keymaps; }
   static const QStringList& get_timezones() { return m_timezones; }
 
-  static bool generate_locale(const QStringList& user_locales, const QString& current);
-  static bool generate_keymap(const std::string& keys, const bool gen_x11_keymap);
-  static bool generate_timezone(const std::string& zone);
+  // root: the installed system, i.e. /mnt
+  static bool generate_locale(const fs::path& root, const QStringList& user_locales, const QString& current);
+  static bool generate_keymap(const fs::path& root, const std::string& keys, const bool gen_x11_keymap);
+  static bool generate_timezone(const fs::path& root, const std::string& zone);
   
 private:
-  static bool write_locale_gen(const QStringList& user_locales);
+  static bool write_locale_gen(const fs::path& root, const QStringList& user_locales);
 
 private:
   static QStringList m_locales;
@@ -0,0 +1,55 @@
+#ifndef ALI_MIRRORS_H
+#define ALI_MIRRORS_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <future>
+#include <cstdint>
+#include <ali/common.hpp>
+
+
+struct MirrorResult
+{
+  std::string server;   // as in mirrorlist, with $repo and $arch
+  uint64_t speed{0};    // bytes per second
+  double latency{0};    // seconds to first byte
+};
+
+using MirrorResults = std::vector<MirrorResult>;
+
+
+// Rank mirrors from the live mirrorlist by downloading a small range from
+// each, concurrently. Runs in the background during the UI, the install 
+// uses the result only if it is ready when pacstrap starts.
+class Mirrors
+{
+public:
+  inline static const fs::path LiveMirrorList{"/etc/pacman.d/mirrorlist"};
+  inline static const fs::path TargetMirrorList{"etc/pacman.d/mirrorlist"}; // relative to the target root
+
+  static constexpr std::size_t MaxCandidates = 40;
+  static constexpr std::size_t MaxConcurrent = 8;
+  static constexpr std::size_t BestCount = 10;
+  static constexpr uint64_t ProbeBytes = 1024 * 1024;
+  static constexpr int ProbeTimeout = 5; // seconds
+
+  static void rank_async();
+
+  // Best mirrors, fastest first. Empty if not finished or no mirror responded. Does not wait.
+  static std::optional<MirrorResults> ranked();
+
+  // Write mirrorlist with servers in order
+  static bool write(const fs::path& path, const MirrorResults& mirrors);
+
+  // Probe the servers of a mirrorlist, blocking. Those which failed are excluded.
+  static MirrorResults rank(const fs::path& mirrorlist);
+
+private:
+  static std::vector<std::string> read_candidates(const fs::path& path);
+
+private:
+  static std::shared_future<MirrorResults> m_ranked;
+};
+
+#endif
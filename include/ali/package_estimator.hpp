@@ -0,0 +1,51 @@
+#ifndef ALI_PACKAGEESTIMATOR_H
+#define ALI_PACKAGEESTIMATOR_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <future>
+#include <cstdint>
+#include <ali/common.hpp>
+
+
+struct PackageEstimate
+{
+  std::size_t packages{0};      // including dependencies
+  uint64_t download_size{0};    // bytes
+  uint64_t installed_size{0};   // bytes
+  std::vector<std::string> unresolved; // not a package, provided or group
+};
+
+
+// Resolves dependency closure of packages against SyncDb to estimate download and
+// installed sizes. ETA is from the download speed measured from the first mirror.
+class PackageEstimator
+{
+public:
+  inline static const fs::path MirrorListPath{"/etc/pacman.d/mirrorlist"};
+
+  // Empty if SyncDb is not loaded yet, or unavailable. Does not wait for SyncDb.
+  static std::optional<PackageEstimate> estimate(const std::vector<std::string>& names);
+
+  // All packages selected in Packages
+  static std::optional<PackageEstimate> estimate_selected();
+
+  // Start measuring download speed on a background thread
+  static void measure_speed_async();
+  
+  // Bytes per second. Empty if not measured yet or it failed. Does not wait.
+  static std::optional<uint64_t> download_speed();
+
+  static std::optional<std::chrono::seconds> eta(const PackageEstimate& estimate);
+  
+private:
+  static uint64_t measure_speed();
+  static std::string first_mirror_url(const std::string_view repo, const std::string_view file);
+
+private:
+  static std::shared_future<uint64_t> m_speed;
+};
+
+#endif
@@ -1,194 +1,167 @@
 #ifndef ALI_PACKAGES_H
 #define ALI_PACKAGES_H
 
-#include <set>
+#include <bitset>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <ostream>
+#include <ranges>
+#include <shared_mutex>
+#include <initializer_list>
+#include <cstdint>
 #include <QString>
+#include <QStringList>
 #include <QDebug>
 
 
-struct Package
-{
-  Package(const std::string_view name) : Package(QString::fromLocal8Bit(name.data(), name.size()))
-  {
-
-  }
+// Index of an interned package name in Packages
+using PackageId = uint32_t;
 
-  Package(const QString& name) : name(name)
-  {
-  }
-  
-  Package(const Package&) = default;
-  Package& operator=(const Package&) = default;
-  Package& operator=(Package&&) = default;
 
-  QString name;
+enum class PackageCategory : uint8_t
+{
+  Kernel,
+  Required,
+  Firmware,
+  Important,
+  Shell,      // UI only permits one for now
+  Profile,    // packages for the profile
+  Video,      // packages for the video/gpu
+  Greeter,
+  Additional, // user-typed
+  Max
 };
 
-struct PackageCmp
+using PackageCategories = std::bitset<static_cast<std::size_t>(PackageCategory::Max)>;
+
+
+// Packages sorted by name, without duplicates. Created by Packages, which
+// owns the names.
+class PackageSet
 {
-  bool operator()(const Package& a, const Package& b) const
-  {
-    return a.name < b.name;
-  }
-};
+  friend class Packages;
+
+public:
+  PackageSet() = default;
 
+  bool empty() const { return m_ids.empty(); }
+  std::size_t size() const { return m_ids.size(); }
 
-using PackageSet = std::set<Package, PackageCmp>;
+  bool contains(const std::string_view name) const;
+
+  // names, in order
+  auto names() const;
+
+  const std::vector<PackageId>& ids() const { return m_ids; }
+
+private:
+  std::vector<PackageId> m_ids;
+};
 
 
 class Packages
 {
 public:
-  static void add_kernel(const QString& name) { add(name, m_kernels); }
-  static void remove_kernel(const QString& name) { remove(name, m_kernels); }
+  static void add_kernel(const QString& name) { add(name, PackageCategory::Kernel); }
+  static void remove_kernel(const QString& name) { remove(name, PackageCategory::Kernel); }
 
-  static void add_required(const QString& name)  { add(name, m_required); }
-  static void remove_required(const QString& name)  { remove(name, m_required); }
+  static void add_required(const QString& name)  { add(name, PackageCategory::Required); }
+  static void remove_required(const QString& name)  { remove(name, PackageCategory::Required); }
 
-  static void add_firmware(const QString& name)  { add(name, m_firmware); }
-  static void remove_firmware(const QString& name)  { remove(name, m_firmware); };
+  static void add_firmware(const QString& name)  { add(name, PackageCategory::Firmware); }
+  static void remove_firmware(const QString& name)  { remove(name, PackageCategory::Firmware); };
 
-  static void add_important(const QString& name)  { add(name, m_important); }
-  static void remove_important(const QString& name)  { remove(name, m_important); };
+  static void add_important(const QString& name)  { add(name, PackageCategory::Important); }
+  static void remove_important(const QString& name)  { remove(name, PackageCategory::Important); };
 
-  static void add_additional(const QStringList& names)  { add(names, m_additional); }
-  static void remove_additional(const QStringList& names)  { remove(names, m_additional); }; 
+  static void add_additional(const QStringList& names)  { add(names, PackageCategory::Additional); }
+  static void remove_additional(const QStringList& names)  { remove(names, PackageCategory::Additional); }; 
 
-  static void set_shell(const QString& name)  { set({name}, m_shells); }
+  static void set_shell(const QString& name)  { set({name}, PackageCategory::Shell); }
 
-  static void set_profile_packages(const QStringList& names) { set(names, m_profile); }
-  static void set_greeter_packages(const QStringList& names) { set(names, m_greeter); }
-  static void set_video_packages(const QStringList& names) { set(names, m_video); }
+  static void set_profile_packages(const QStringList& names) { set(names, PackageCategory::Profile); }
+  static void set_greeter_packages(const QStringList& names) { set(names, PackageCategory::Greeter); }
+  static void set_video_packages(const QStringList& names) { set(names, PackageCategory::Video); }
 
 
-  static const PackageSet& kernels() { return m_kernels; }
-  static const PackageSet& required() { return m_required; }
-  static const PackageSet& firmware() { return m_firmware; }
-  static const PackageSet& important() { return m_important; }
-  static const PackageSet& shells() { return m_shells; }
-  static const PackageSet& profile() { return m_profile; }
-  static const PackageSet& video() { return m_video; }
-  static const PackageSet& greeter() { return m_greeter; }
-  static const PackageSet& additional() { return m_additional; }
-  
+  static PackageSet kernels() { return get(PackageCategory::Kernel); }
+  static PackageSet required() { return get(PackageCategory::Required); }
+  static PackageSet firmware() { return get(PackageCategory::Firmware); }
+  static PackageSet important() { return get(PackageCategory::Important); }
+  static PackageSet shells() { return get(PackageCategory::Shell); }
+  static PackageSet profile() { return get(PackageCategory::Profile); }
+  static PackageSet video() { return get(PackageCategory::Video); }
+  static PackageSet greeter() { return get(PackageCategory::Greeter); }
+  static PackageSet additional() { return get(PackageCategory::Additional); }
+
+  // Union of categories: a package in more than one category appears once
+  static PackageSet get(const std::initializer_list<PackageCategory> categories);
+  static PackageSet get(const PackageCategory category) { return get({category}); }
+  static PackageSet all();
+
+  // Set of names not managed in a category (i.e. profile commands)
+  static PackageSet make_set(const QStringList& names);
 
-  static void dump_kernels (QDebug& q) { dump(q, m_kernels); }
-  static void dump_required (QDebug& q) { dump(q, m_required); }
-  static void dump_firmware (QDebug& q) { dump(q, m_firmware); }
-  static void dump_important (QDebug& q) { dump(q, m_important); }
-  static void dump_shells (QDebug& q) { dump(q, m_shells); }
-  static void dump_profile (QDebug& q) { dump(q, m_profile); }
-  static void dump_additional (QDebug& q) { dump(q, m_additional); }
-  static void dump_greeter (QDebug& q) { dump(q, m_greeter); }
-
-
-  static bool have_kernel () { return !m_kernels.empty(); }
-  static bool have_required () { return !m_required.empty(); }
-
-  static bool have_package(const QString& name)
-  {
-    auto contains = [&name](const PackageSet& ps)
-    {
-      return ps.contains(name);
-    };
-
-    // a tad ugly
-    return  contains(m_additional) || contains(m_profile) || contains(m_kernels) ||
-            contains(m_required) || contains(m_important) || contains(m_video) ||
-            contains(m_shells) || contains(m_greeter) ;
-  }
+  static bool have_kernel () { return have(PackageCategory::Kernel); }
+  static bool have_required () { return have(PackageCategory::Required); }
+  static bool have_package(const std::string_view name);
+
+  // names from all categories, without duplicates
+  static std::vector<std::string> all_names();
+
+  // by value, the names can be reallocated by another thread
+  static std::string name(const PackageId id);
   
+  static void dump(QDebug& q);
 
 private:
+  static PackageId intern(const std::string_view name);
+  static PackageId intern(const QString& name) { return intern(name.toStdString()); }
+  // binary search of m_sorted, nullptr if not interned
+  static const PackageId * find(const std::string_view name);
 
-  static void add(const QString& name, PackageSet& ps)
-  {
-    ps.emplace(name);
-  }
-
-  static void add(const QStringList& names, PackageSet& ps)
-  {
-    ps.insert(names.cbegin(), names.cend());
-  }
-
-  static void set(const QStringList& names, PackageSet& ps)
-  {
-    ps = PackageSet{names.cbegin(), names.cend()};
-  }
-
-  static void remove (const QStringList& names, PackageSet& ps)
-  {
-    for(const auto& name : names)
-      ps.erase(name);
-  }
-
-  static void remove (const QString& name, PackageSet& ps)
-  {
-    ps.erase(name);
-  }
-
-  static void dump(QDebug& q, const PackageSet& packages, const char sep = '\n')
-  {
-    for (const auto& p : packages)
-      q << p.name << sep;
-  }
-
-  static void dump(std::ostream& s, const PackageSet& packages, const char sep)
-  {
-    for (const auto& p : packages)
-      s << p.name.toStdString() << sep;
-  }
+  static void add(const QString& name, const PackageCategory c) { add(QStringList{name}, c); }
+  static void add(const QStringList& names, const PackageCategory c);
+  static void remove(const QString& name, const PackageCategory c) { remove(QStringList{name}, c); }
+  static void remove(const QStringList& names, const PackageCategory c);
+  static void set(const QStringList& names, const PackageCategory c);
+  static bool have(const PackageCategory c);
 
+  static constexpr std::size_t index(const PackageCategory c) { return static_cast<std::size_t>(c); }
 
 private:
-  static PackageSet m_kernels;
-  static PackageSet m_required;
-  static PackageSet m_firmware;
-  static PackageSet m_important;
-  static PackageSet m_shells;     // UI only permits one for now
-  static PackageSet m_profile;    // packages for the profile
-  static PackageSet m_video;      // packages for the video/gpu  
-  static PackageSet m_greeter;      
-  static PackageSet m_additional; // user-typed
+  friend class PackageSet;
+
+  // Install threads (one per target) make sets while the UI thread reads and changes
+  // the categories. intern() and find() require the lock to be held
+  inline static std::shared_mutex m_mutex;
+
+  // all indexed by PackageId
+  static std::vector<std::string> m_names;
+  static std::vector<PackageCategories> m_categories;
+  // ids sorted by name, for lookup and sorted output
+  static std::vector<PackageId> m_sorted;
 };
 
 
+inline auto PackageSet::names() const
+{
+  return m_ids | std::views::transform([](const PackageId id) { return Packages::name(id); });
+}
+
+
 inline std::ostream& operator<<(std::ostream& s, const PackageSet& ps)
 { 
-  for (const auto& p : ps)
-    s << p.name.toStdString() << ' ';
+  for (const auto& name : ps.names())
+    s << name << ' ';
   return s;
 }
 
 
 inline QDebug operator<<(QDebug q, const Packages& p)
 {
-  q << "Required:\n";
-  p.dump_required(q);
-
-  q << "Kernels:\n";
-  p.dump_kernels(q);
-
-  q << "Firmware:\n";
-  p.dump_firmware(q);
-
-  q << "Important:\n";
-  p.dump_important(q);
-
-  q << "Shells:\n";
-  p.dump_shells(q);
-
-  q << "Profile:\n";
-  p.dump_profile(q);
-
-  q << "Greeter:\n";
-  p.dump_greeter(q);
-
-  q << "Additional:\n";
-  p.dump_additional(q);
-
+  p.dump(q);
   return q;
 }
 
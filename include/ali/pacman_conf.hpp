@@ -0,0 +1,37 @@
+#ifndef ALI_PACMANCONF_H
+#define ALI_PACMANCONF_H
+
+#include <string>
+#include <optional>
+#include <cstdint>
+#include <ali/common.hpp>
+
+
+struct PacmanSettings
+{
+  int parallel_downloads{5};
+  bool disable_download_timeout{false};
+
+  // From measured download speed (bytes/s) from a single mirror. A single connection
+  // rarely saturates a fast link, so faster links get more parallel downloads.
+  // Slow links disable the timeout, which otherwise aborts stalled downloads.
+  static PacmanSettings from_speed(const std::optional<uint64_t> speed);
+
+  std::string summary() const
+  {
+    return std::format("ParallelDownloads = {}, DisableDownloadTimeout = {}", parallel_downloads, disable_download_timeout);
+  }
+};
+
+
+// Edit the [options] section of a pacman.conf, preserving everything else
+class PacmanConf
+{
+public:
+  inline static const fs::path LivePath{"/etc/pacman.conf"};
+  inline static const fs::path TargetPath{"etc/pacman.conf"}; // relative to the target root
+
+  static bool apply(const fs::path& path, const PacmanSettings& settings);
+};
+
+#endif
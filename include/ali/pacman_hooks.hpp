@@ -0,0 +1,38 @@
+#ifndef ALI_PACMANHOOKS_H
+#define ALI_PACMANHOOKS_H
+
+#include <string>
+#include <vector>
+#include <ali/common.hpp>
+#include <ali/profiles.hpp>
+
+
+// Each pacman transaction runs the hooks of the packages it installs, and an install has
+// many transactions. The expensive hooks (initramfs, DKMS, caches) would run repeatedly,
+// i.e. mkinitcpio after pacstrap then again after nvidia-dkms.
+//
+// These are masked in the target for the install, by a symlink to /dev/null in the target's
+// hook directory, which overrides the package's hook. When all packages are installed, each
+// hook of an installed package runs once:
+//  - DKMS modules for every kernel, before the initramfs which may include them
+//  - then the initramfs of each kernel and the caches, in parallel
+class PacmanHooks
+{
+public:
+  inline static const fs::path HooksDir{"etc/pacman.d/hooks"};  // relative to the target root
+  static constexpr char InitramfsGroup[] = "initramfs";
+
+  static bool defer(const fs::path& root);
+  static void restore(const fs::path& root);
+
+  // pacstrap runs pacman outside the target, which otherwise uses the live hook directory
+  static std::string hookdir_option(const fs::path& root);
+
+  // the deferred hooks of installed packages, empty if there are none
+  static std::vector<CommandGroup> groups(const fs::path& root);
+
+private:
+  static std::vector<std::string> kernels(const fs::path& root);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef ALI_PARTITIONER_H
+#define ALI_PARTITIONER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <ali/common.hpp>
+
+
+// GPT partition type GUIDs, see:
+// https://uapi-group.org/specifications/specs/discoverable_partitions_specification/
+struct EfiType
+{
+  static constexpr char guid[] = "c12a7328-f81f-11d2-ba4b-00a0c93ec93b";
+  static constexpr char name[] = "efi";
+};
+
+struct LinuxRootType
+{
+  static constexpr char guid[] = "4f68bce3-e8cd-4db1-96e7-fbcaf984b709"; // x86-64
+  static constexpr char name[] = "root";
+};
+
+struct LinuxHomeType
+{
+  static constexpr char guid[] = "933ac7e1-2eb4-4f13-b844-0e14e2aef915";
+  static constexpr char name[] = "home";
+};
+
+struct LinuxSwapType
+{
+  static constexpr char guid[] = "0657fd6d-a4ab-43c4-84e5-0933c84b4f4f";
+  static constexpr char name[] = "swap";
+};
+
+
+enum class PartitionRole { Efi, Root, Home, Swap };
+
+
+// Partitions to create on a disk, in order. A size of 0 means use the remaining
+// space, which is only permitted for the last partition.
+struct PartitionPlan
+{
+  static constexpr uint64_t MiB = 1024 * 1024;
+  static constexpr uint64_t GiB = 1024 * MiB;
+
+  static constexpr uint64_t EfiSize = 1 * GiB;
+  static constexpr uint64_t MinRootSize = 16 * GiB;
+  static constexpr uint64_t DefaultRootSize = 64 * GiB;  // if /home is separate
+
+  struct Part
+  {
+    PartitionRole role;
+    uint64_t size{0}; // bytes
+  };
+
+  std::string dev;  // whole disk: /dev/sda, /dev/nvme0n1
+  std::vector<Part> parts;
+
+  // EFI, swap (if swap_size), root then home (if separate_home). If the disk is too small
+  // for a separate home, root uses the remaining space.
+  static PartitionPlan create_default(const std::string_view dev, const uint64_t disk_size, const bool separate_home, const uint64_t swap_size = 0);
+
+  bool is_valid(const uint64_t disk_size) const;
+};
+
+
+// Partitioning with libfdisk. Changes are made in memory then written 
+// in a single write of the partition table.
+class Partitioner
+{
+public:
+  // Create a new GPT label on the disk, removing all existing partitions, then create
+  // partitions in the plan. Start and sizes are aligned to the device's optimal I/O size
+  // (minimum 1MiB).
+  static bool create(const PartitionPlan& plan);
+
+  // Set type of an existing partition on a GPT disk. part_num starts at 1.
+  template<class T>
+  static bool set_type(const std::string_view disk, const int part_num)
+  {
+    return set_type(disk, part_num, T::guid);
+  }
+
+  static bool set_type(const std::string_view disk, const int part_num, const std::string_view type_guid);
+
+private:
+  static const char * role_guid(const PartitionRole role);
+  static const char * role_name(const PartitionRole role);
+};
+
+#endif
@@ -7,6 +7,20 @@
 #include <QJsonDocument>
 #include <QJsonValue>
 #include <map>
+#include <vector>
+
+
+// Commands in a group run sequentially. Groups run in declaration order unless 'parallel',
+// in which case they run concurrently with other parallel groups whose 'after' groups have completed.
+struct CommandGroup
+{
+  QString name;
+  QStringList commands;
+  QStringList after;    // names of groups which must complete first
+  bool user{false};     // run as the created user, otherwise root
+  bool parallel{false};
+};
+
 
 struct Profile
 {
@@ -16,6 +30,27 @@ struct Profile
   QStringList user_commands; // commands to run as user
   QString info; // info to user for post-install guide
   bool is_tty; // true if profile is tty (no x11/wayland)
+  std::vector<CommandGroup> command_groups;
+
+  // system_commands and user_commands as groups, "system" and "user" (after "system"),
+  // followed by command_groups
+  std::vector<CommandGroup> all_command_groups() const
+  {
+    std::vector<CommandGroup> groups;
+
+    if (!system_commands.empty())
+      groups.emplace_back(CommandGroup{.name = "system", .commands = system_commands, .parallel = true});
+    
+    if (!user_commands.empty())
+    {
+      groups.emplace_back(CommandGroup{ .name = "user", .commands = user_commands,
+                                        .after = system_commands.empty() ? QStringList{} : QStringList{"system"},
+                                        .user = true, .parallel = true});
+    }
+
+    groups.insert(groups.end(), command_groups.cbegin(), command_groups.cend());
+    return groups;
+  }
 };
 
 
@@ -24,6 +59,9 @@ class Profiles
   using ProfilesMap = std::map<QString, Profile>;
 
 public:
+  // Override the compiled profiles. Same layout as profiles/ in the repo.
+  inline static const fs::path OverridePath{"/etc/ali/profiles"};
+
   static bool read();
   static QStringList get_desktop_profile_names();
   static QStringList get_tty_profile_names();
@@ -36,9 +74,11 @@ public:
 private:
   enum class Commands { System, User };
 
+  static void read_embedded();
   static bool read_profiles(const fs::path& dir, ProfilesMap& profiles);
   static bool read_profile (const fs::path path, const QJsonDocument& doc, ProfilesMap& profiles);
   static bool read_greeters (const fs::path& path);
+  static bool read_command_groups (const QJsonArray& arr, std::vector<CommandGroup>& groups);
 
   static bool validate(const QJsonObject& root, const QString& key, const QJsonValue::Type t, const bool required = true);
   static bool to_stringlist(const QJsonArray& arr, QStringList& dest);
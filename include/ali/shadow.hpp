@@ -0,0 +1,25 @@
+#ifndef ALI_SHADOW_H
+#define ALI_SHADOW_H
+
+#include <string>
+#include <string_view>
+#include <ali/common.hpp>
+
+
+// Set passwords by editing shadow directly, rather than chpasswd in a chroot.
+// Hashed with yescrypt (the Arch default) using libcrypt.
+class Shadow
+{
+public:
+  inline static const fs::path TargetPath{"etc/shadow"}; // relative to the target root
+
+  // The user must already exist in the file. Written atomically, then verified
+  // by reading the file again.
+  static bool set_password(const fs::path& path, const std::string_view user, const std::string_view password);
+
+  // Empty on failure
+  static std::string hash(const std::string_view password);
+  static bool verify(const std::string_view password, const std::string_view hash);
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef ALI_SHAREDINSTALL_H
+#define ALI_SHAREDINSTALL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ali/common.hpp>
+#include <ali/install_target.hpp>
+
+
+// Work shared by targets installing concurrently. After mounting, each target waits
+// for the others, then the last to arrive runs the shared step once: packages are
+// downloaded to one cache, on the first target that mounted. The other targets bind
+// mount that cache, so pacstrap and pacman find the packages rather than downloading.
+class SharedInstall
+{
+public:
+  using Log = std::function<void(const std::string_view)>;
+  using Step = std::function<bool(const fs::path& cache)>;
+
+  inline static const fs::path CachePath {"var/cache/pacman/pkg"}; // relative to target root
+  inline static const fs::path DbPath {"/tmp/ali/shared-db"};
+
+  // every target must call arrive(), including those that failed to mount
+  explicit SharedInstall(const std::size_t n_targets);
+
+  // Blocks until all targets arrive. Returns the cache, empty if no target
+  // mounted or the step failed.
+  fs::path arrive(const InstallTarget& target, const bool mounted, const Step& step);
+
+  // Download packages and their dependencies, using an empty local database so
+  // packages installed in the live system are also downloaded.
+  static bool download(const std::vector<std::string>& packages, const fs::path& cache, const Log& log);
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::size_t m_targets;
+  std::size_t m_arrived{0};
+  bool m_done{false};
+  fs::path m_cache;
+  Step m_step;  // of the first target which mounted
+};
+
+#endif
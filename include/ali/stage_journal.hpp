@@ -0,0 +1,59 @@
+#ifndef ALI_STAGEJOURNAL_H
+#define ALI_STAGEJOURNAL_H
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ali/common.hpp>
+
+
+// Install stages completed on a target, written to the target after each stage, so
+// a failed or interrupted install can resume from the first incomplete stage rather
+// than formatting and downloading again.
+//
+// The journal has the install's inputs (mode, partition UUIDs, etc) which must match
+// to resume, and a digest of each stage's inputs, so a stage is repeated if its inputs
+// changed (i.e. a different profile). The file is replaced atomically on each write.
+class StageJournal
+{
+public:
+  using Inputs = std::map<std::string, std::string, std::less<>>;
+
+  struct Stage
+  {
+    std::string name;
+    std::string digest;
+  };
+
+  inline static const fs::path Path {"var/lib/ali/install.journal"}; // relative to target root
+
+  // a new journal, replacing a previous
+  bool begin(const fs::path& root, const Inputs& inputs);
+  // false if there's no journal, or it's invalid
+  bool load(const fs::path& root);
+  void close();
+
+  bool is_open() const { return !m_path.empty(); }
+
+  bool complete(const std::string_view stage, const std::string_view inputs);
+  bool is_complete(const std::string_view stage) const;
+  // the stage and those after it are no longer complete
+  bool invalidate(const std::string_view stage);
+
+  // empty if not present
+  std::string input(const std::string_view key) const;
+  const std::vector<Stage>& stages() const { return m_stages; }
+
+  static std::string digest(const std::string_view inputs);
+
+private:
+  bool write();
+
+private:
+  fs::path m_path;
+  Inputs m_inputs;
+  std::vector<Stage> m_stages;
+};
+
+#endif
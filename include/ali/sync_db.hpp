@@ -0,0 +1,105 @@
+#ifndef ALI_SYNCDB_H
+#define ALI_SYNCDB_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+#include <span>
+#include <future>
+#include <cstdint>
+#include <ali/common.hpp>
+
+
+// Index into SyncDb's string pool. Names, versions, etc are interned so
+// each distinct string is stored once (i.e. "glibc" appears in thousands of depends).
+using StrId = uint32_t;
+
+
+struct SyncPackage
+{
+  // range in SyncDb's id store
+  struct Ids
+  {
+    uint32_t begin{0};
+    uint32_t count{0};
+  };
+
+  StrId name{0};
+  StrId version{0};
+  StrId repo{0};
+  uint64_t download_size{0};  // %CSIZE%
+  uint64_t installed_size{0}; // %ISIZE%
+  Ids depends;  // names only, version constraints removed
+  Ids provides; // names only, versions removed
+  Ids groups;
+};
+
+
+// Package metadata from the pacman sync databases (/var/lib/pacman/sync/<repo>.db).
+// The databases are read once on a background thread, calls which read the index
+// wait until loading has finished.
+class SyncDb
+{
+public:
+  inline static const fs::path SyncDir{"/var/lib/pacman/sync"};
+
+  // Start loading on a background thread. In prod, if the databases don't exist
+  // they are synced first (pacman -Sy).
+  static void load_async();
+
+  // Wait for load to complete. Calls load_async() if not already called.
+  // Returns false if no database could be read.
+  static bool wait();
+
+  // Loaded successfully, does not wait
+  static bool is_ready()
+  {
+    return m_loaded.valid() && m_loaded.wait_for(std::chrono::seconds{0}) == std::future_status::ready && m_loaded.get();
+  }
+
+  static bool contains(const std::string_view name) { return find(name) != nullptr; }
+
+  // By exact name
+  static const SyncPackage * find(const std::string_view name);
+  // By exact name, otherwise first package which provides name (i.e. "sh" -> bash)
+  static const SyncPackage * find_provider(const std::string_view name);
+  // Packages in a group (i.e. "base-devel"), empty if group does not exist
+  static std::vector<const SyncPackage *> group(const std::string_view name);
+
+  static std::string_view str(const StrId id) { return m_strings[id]; }
+  static std::span<const StrId> ids(const SyncPackage::Ids ids) { return {m_ids.data() + ids.begin, ids.count}; }
+
+  static std::size_t size() { return m_packages.size(); }
+
+private:
+  static bool load();
+  static bool read_db(const fs::path& path, const std::string_view repo);
+  static void parse_desc(const std::string_view content, SyncPackage& pkg);
+  static StrId intern(const std::string_view s);
+  static std::string_view strip_constraint(const std::string_view s);
+
+private:
+  struct Hash
+  {
+    using is_transparent = void;
+    std::size_t operator()(const std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    std::size_t operator()(const StrId id) const { return std::hash<StrId>{}(id); }
+  };
+
+  static std::shared_future<bool> m_loaded;
+
+  // string pool: deque so string_views into it remain valid as it grows
+  static std::deque<std::string> m_string_store;
+  static std::vector<std::string_view> m_strings;
+  static std::unordered_map<std::string_view, StrId, Hash, std::equal_to<>> m_string_ids;
+
+  static std::vector<SyncPackage> m_packages;
+  static std::vector<StrId> m_ids;  // depends, provides and groups for all packages
+  static std::unordered_map<StrId, uint32_t, Hash> m_by_name;               // name -> package index
+  static std::unordered_multimap<StrId, uint32_t, Hash> m_by_provides;      // provided -> package index
+  static std::unordered_multimap<StrId, uint32_t, Hash> m_by_group;         // group -> package index
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef ALI_SYSTEMIMAGE_H
+#define ALI_SYSTEMIMAGE_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ali/common.hpp>
+
+
+// A chunk is one zstd compressed tar, of one or more paths relative to the root, or
+// a btrfs send stream of the root subvolume.
+struct ImageChunk
+{
+  std::string file;               // within the image directory, i.e. "usr_lib.tar.zst"
+  std::vector<std::string> paths; // relative to root
+  std::vector<std::string> empty_dirs; // directory only, without contents (i.e. mount points)
+  bool send_stream{false};
+};
+
+
+// Capture an installed system to an image directory, or deploy an image to a root.
+//
+// The image is split into chunks, by top level directory (and /usr by its children),
+// so they can be compressed and extracted concurrently: zstd compresses with threads
+// but decompression is single threaded. Ownership, permissions, ACLs and xattrs
+// (which includes file capabilities) are kept.
+//
+// If the root is btrfs, the root subvolume is also captured with `btrfs send`. When
+// deploying to btrfs, that is received then snapshotted as the root subvolume, which
+// is quicker than extracting, and the extents stay compressed. Only /home is extracted.
+//
+// Machine specific files are not captured (hostname, fstab, machine-id, ssh host keys,
+// pacman keyring), nor are the package cache and logs. The machine-id and keyring are
+// created when deploying.
+class SystemImage
+{
+public:
+  using Log = std::function<void(const std::string_view)>;
+
+  static constexpr std::string_view ManifestName {"ali-image.manifest"};
+  static constexpr std::string_view SendStreamName {"root.btrfs"};
+  static constexpr std::string_view BaseSubvolume {"@ali-image"}; // sent and received, deleted after the snapshot
+  static constexpr std::string_view HomeChunk {"home.tar.zst"};
+  static constexpr int CompressionLevel = 6;
+
+  SystemImage(Log&& info, Log&& warning);
+
+  // btrfs_top_level: if not empty, the root's btrfs top level subvolume mounted, to send 'subvolume'
+  bool capture(const fs::path& root, const fs::path& image_dir, const fs::path& btrfs_top_level = {}, const std::string_view subvolume = {});
+
+  // root_received: the root subvolume was received, so only /home is extracted
+  bool deploy(const fs::path& image_dir, const fs::path& root, const bool root_received = false);
+
+  // receive the root subvolume into the top level, then snapshot it as 'subvolume'
+  bool receive(const fs::path& image_dir, const fs::path& btrfs_top_level, const std::string_view subvolume);
+
+  static bool is_image(const fs::path& image_dir);
+  static bool has_send_stream(const fs::path& image_dir);
+
+private:
+  std::vector<ImageChunk> plan(const fs::path& root);
+  bool send(const fs::path& top_level, const std::string_view subvolume, const fs::path& image_dir);
+  void remove_excluded(const fs::path& root);
+  bool write_manifest(const fs::path& image_dir, const std::vector<ImageChunk>& chunks);
+  std::vector<ImageChunk> read_manifest(const fs::path& image_dir);
+  bool run_all(const std::vector<std::string>& cmds);
+
+private:
+  Log m_info, m_warning;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef ALI_UNITENABLER_H
+#define ALI_UNITENABLER_H
+
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ali/common.hpp>
+
+
+// Enables systemd units in a root without a chroot, equivalent of `systemctl --root=<root> enable`.
+// Reads the unit's [Install] section then creates the symlinks for WantedBy, RequiredBy
+// and Alias, and enables units in Also.
+class UnitEnabler
+{
+public:
+  UnitEnabler(const fs::path& root);
+
+  // Returns false if a unit file is not found or a symlink could not be created.
+  // A unit without an [Install] section (static) is not an error.
+  bool enable(const std::string_view unit);
+  bool enable(const std::vector<std::string>& units);
+
+  // If cmd is only "systemctl enable <units>", returns the units. Empty otherwise.
+  static std::vector<std::string> parse_enable_command(const std::string_view cmd);
+
+private:
+  struct InstallSection
+  {
+    std::vector<std::string> wanted_by;
+    std::vector<std::string> required_by;
+    std::vector<std::string> alias;
+    std::vector<std::string> also;
+    std::string default_instance;
+  };
+
+  // path relative to the root, i.e. /usr/lib/systemd/system/iwd.service
+  fs::path find_unit(const std::string_view name) const;
+  bool read_install_section(const fs::path& path, InstallSection& section) const;
+  bool link(const fs::path& link_path, const fs::path& target) const;
+
+private:
+  fs::path m_root;
+  std::set<std::string, std::less<>> m_enabled; // prevents loops with Also
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef ALI_VMPLAN_H
+#define ALI_VMPLAN_H
+
+#include <string>
+#include <vector>
+#include <QStringList>
+#include <ali/common.hpp>
+
+
+enum class Hypervisor
+{
+  None,
+  Kvm,        // including QEMU without KVM, and clouds using KVM
+  VMware,
+  VirtualBox,
+  HyperV,
+  Xen,
+  Parallels,
+  Unknown     // the CPU reports a hypervisor, but DMI doesn't identify it
+};
+
+
+// What changes when installing in a VM:
+//  - no microcode or firmware: the host handles both
+//  - guest agent packages, and their services
+//  - the paravirtual storage drivers in the initramfs, so an image or template still
+//    boots if the VM's disk controller changes (autodetect only has the current one)
+//  - discard on mounts, so a thin provisioned disk shrinks when files are deleted
+//  - a smaller zram, VMs are usually given less RAM
+//
+// The hypervisor is detected from the CPUID hypervisor flag (in /proc/cpuinfo) and
+// the DMI vendor and product (in sysfs), without running a command.
+struct VmPlan
+{
+  Hypervisor hypervisor{Hypervisor::None};
+  QStringList guest_packages;
+  std::vector<std::string> guest_services;
+  QStringList initramfs_modules;
+  std::string zram_size{"min(ram / 2, 4096)"}; // zram-generator expression, default for bare metal
+
+  bool is_vm() const { return hypervisor != Hypervisor::None; }
+  std::string name() const;
+
+  // detected once, the result is cached
+  static const VmPlan& get();
+  static Hypervisor detect();
+
+private:
+  static VmPlan create(const Hypervisor hypervisor);
+};
+
+#endif
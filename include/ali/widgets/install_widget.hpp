@@ -3,9 +3,12 @@
 
 #include <QFileSystemWatcher>
 #include <thread>
+#include <memory>
+#include <vector>
 #include <ali/common.hpp>
 #include <ali/widgets/content_widget.hpp>
 #include <ali/install.hpp>
+#include <ali/shared_install.hpp>
 
 struct LogWidget;
 
@@ -22,12 +25,22 @@ public:
 signals:
   void on_install_begin();
   void on_install_end();
+  void on_targets_partitioned();
 
 protected:
   virtual void focusInEvent(QFocusEvent *event) override;
   
 private:
   void validate();
+  void show_estimate();
+  InstallMode get_mode() const;
+  void connect_log(Install& installer, LogWidget * log);
+  void set_target_status(const int tab, const CompleteStatus status);
+  QWidget * create_targets();
+  BlankDisks get_target_disks() const;
+  std::vector<MountData> partition_targets(const BlankDisks& disks, const MountData& primary);
+  void cancel();
+  void enable_install();
 
   virtual bool is_install_widget() const override
   {
@@ -36,6 +49,7 @@ private:
 
   #ifdef ALI_PROD
     void install();
+    void install_targets(const std::vector<MountData>& targets, const MountData& mounts, const InstallMode mode, const fs::path& image_dir);
     virtual bool is_valid() override { return true; }
   #else
     void install(){};
@@ -44,11 +58,26 @@ private:
 
 private:
   LogWidget * m_log_widget;
+  QTabWidget * m_logs;
   QPushButton * m_btn_install{nullptr};
+  QPushButton * m_btn_cancel{nullptr};
   QLabel * m_lbl_waffle;
+  QLabel * m_lbl_estimate;
   QLabel * m_lbl_busy;
+  QComboBox * m_mode;
+  QLineEdit * m_image_dir;
+  QListWidget * m_targets{nullptr};
+  BlankDisks m_blank_disks;
   std::jthread m_install_thread;
   Install m_installer;
+  // additional targets, installed concurrently with m_installer
+  std::unique_ptr<SharedInstall> m_shared;
+  std::vector<std::unique_ptr<Install>> m_multi_installers;
+  std::vector<std::jthread> m_multi_threads;
+  // blank disks are partitioned and probed here, then the installs start
+  std::vector<std::string> m_partition_log;
+  std::vector<MountData> m_partitioned;
+  std::jthread m_partition_thread;
 };
 
 
@@ -2,6 +2,7 @@
 #define ALI_PACKAGESWIDGET_H
 
 #include <ali/widgets/content_widget.hpp>
+#include <ali/sync_db.hpp>
 #include <QSet>
 #include <QString>
 #include <QNetworkRequest>
@@ -90,6 +91,22 @@ public:
       return;
     }
 
+    // check all against the local sync databases in one pass. This is the UI thread, so
+    // if they're still loading (or being synced), use the web search rather than wait
+    if (SyncDb::is_ready())
+    {
+      for (const auto& name : packages)
+      {
+        if (const auto str = name.toString(); SyncDb::contains(str.toStdString()))
+          m_exist.append(str);
+        else
+          m_invalid.append(str);
+      }
+
+      emit on_complete(m_exist, m_invalid);
+      return;
+    }
+
     m_expected_reply_count = packages.size();
 
     for (const auto& name : packages)
@@ -147,6 +164,7 @@ private:
   SelectPackagesWidget * m_firmware;  
   SelectPackagesWidget * m_important;
   SelectPackagesWidget * m_shell;
+  SelectPackagesWidget * m_vm{nullptr};
   AdditionalPackagesWidget * m_additional;
 };
 
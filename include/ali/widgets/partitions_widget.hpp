@@ -22,6 +22,7 @@ struct MountData
   Mount root;
   Mount efi;
   Mount home;
+  BtrfsMountProfile btrfs; // only applies if root and/or home are btrfs
 };
 
 
@@ -37,8 +38,11 @@ struct PartitionsWidget : public ContentWidget
   std::pair<bool, MountData> get_data() ;
 
 private:
+  void populate();
   std::pair<bool, std::string> get_fs_from_path(const std::string& path);
   QTableWidget *  create_table();
+  QWidget * create_blank_disks();
+  bool is_root_size_valid(const MountData& mounts);
 
 private:
   SelectMounts * m_mounts_widget{nullptr};
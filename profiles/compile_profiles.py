@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+
+# Compiles the profiles and greeters into a C++ header, which is embedded
+# in ali so profiles are not parsed at runtime. Called by meson, which passes
+# each file, so a profile is compiled only if it's listed in meson.build.
+#
+# Validates the structure, failing the build if a profile is invalid.
+
+import argparse
+import json
+import pathlib
+import sys
+
+
+def fail(msg):
+  print(f'compile_profiles: {msg}', file=sys.stderr)
+  sys.exit(1)
+
+
+def check(obj, key, t, path, required=True, strings=True):
+  if key not in obj:
+    if required:
+      fail(f'{path}: "{key}" missing')
+    return
+  if not isinstance(obj[key], t):
+    fail(f'{path}: "{key}" has wrong type, expected {t.__name__}')
+  if t is list and strings and not all(isinstance(v, str) for v in obj[key]):
+    fail(f'{path}: "{key}" must only contain strings')
+
+
+def check_packages(packages, path):
+  for p in packages:
+    if not p or any(c.isspace() for c in p):
+      fail(f'{path}: invalid package name "{p}"')
+
+
+def check_command_groups(profile, path):
+  groups = profile.get('command_groups', [])
+  # system_commands and user_commands are implicit groups
+  names = ['system', 'user']
+
+  for group in groups:
+    if not isinstance(group, dict):
+      fail(f'{path}: command group must be an object')
+    
+    check(group, 'name', str, path)
+    check(group, 'commands', list, path)
+    check(group, 'after', list, path, False)
+    check(group, 'user', bool, path, False)
+    check(group, 'parallel', bool, path, False)
+
+    if group['name'] in names:
+      fail(f'{path}: command group "{group["name"]}" is duplicated or reserved')
+    names.append(group['name'])
+  
+  # 'after' must refer to an earlier group, which also prevents cycles
+  seen = ['system', 'user']
+  for group in groups:
+    for dep in group.get('after', []):
+      if dep not in seen:
+        fail(f'{path}: command group "{group["name"]}" is after "{dep}", which is not an earlier group')
+    seen.append(group['name'])
+
+
+def read_profile(path, is_tty):
+  try:
+    root = json.loads(path.read_text())
+  except json.JSONDecodeError as e:
+    fail(f'{path}: invalid JSON: {e}')
+  
+  if not isinstance(root, dict):
+    fail(f'{path}: root is not an object')
+
+  check(root, 'name', str, path)
+  check(root, 'packages', list, path)
+  check(root, 'system_commands', list, path)
+  check(root, 'user_commands', list, path)
+  check(root, 'info', str, path, False)
+  check(root, 'command_groups', list, path, False, strings=False)
+  check_packages(root['packages'], path)
+  check_command_groups(root, path)
+
+  root['tty'] = is_tty
+  return root
+
+
+def read_greeters(path):
+  try:
+    root = json.loads(path.read_text())
+  except json.JSONDecodeError as e:
+    fail(f'{path}: invalid JSON: {e}')
+
+  if not isinstance(root, list):
+    fail(f'{path}: root is not an array')
+  
+  for greeter in root:
+    if not isinstance(greeter, dict):
+      fail(f'{path}: greeter must be an object')
+    
+    check(greeter, 'name', str, path)
+    check(greeter, 'tty', bool, path)
+    check(greeter, 'packages', list, path)
+    check(greeter, 'system_commands', list, path)
+    check(greeter, 'user_commands', list, path, False)
+    check_packages(greeter['packages'], path)
+  
+  return root
+
+
+def check_unique(entries, what):
+  names = [e['name'] for e in entries]
+  for name in names:
+    if names.count(name) > 1:
+      fail(f'{what} "{name}" is duplicated')
+
+
+def cpp_string(s):
+  out = s.replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n')
+  return f'"{out}"'
+
+
+def cpp_list(prefix, name, values, out):
+  if not values:
+    return '{}'
+  out.append(f'inline constexpr std::string_view {prefix}_{name}[] = {{{", ".join(cpp_string(v) for v in values)}}};')
+  return f'{prefix}_{name}'
+
+
+def cpp_command_groups(prefix, groups, out):
+  if not groups:
+    return '{}'
+  
+  rows = []
+  for i, g in enumerate(groups):
+    p = f'{prefix}_group{i}'
+    commands = cpp_list(p, 'commands', g['commands'], out)
+    after = cpp_list(p, 'after', g.get('after', []), out)
+    rows.append(f'  {{{cpp_string(g["name"])}, {str(g.get("user", False)).lower()}, {str(g.get("parallel", False)).lower()}, {commands}, {after}}}')
+  
+  out.append(f'inline constexpr CommandGroupEntry {prefix}_groups[] =\n{{\n' + ',\n'.join(rows) + '\n};')
+  return f'{prefix}_groups'
+
+
+def cpp_entries(var, prefix, entries, out):
+  rows = []
+  for i, e in enumerate(entries):
+    p = f'{prefix}{i}'
+    packages = cpp_list(p, 'packages', e['packages'], out)
+    system = cpp_list(p, 'system_commands', e['system_commands'], out)
+    user = cpp_list(p, 'user_commands', e.get('user_commands', []), out)
+    groups = cpp_command_groups(p, e.get('command_groups', []), out)
+    rows.append(f'  {{{cpp_string(e["name"])}, {cpp_string(e.get("info", ""))}, {str(e["tty"]).lower()}, {packages}, {system}, {user}, {groups}}}')
+  
+  out.append('')
+  if rows:
+    out.append(f'inline constexpr ProfileEntry {var}[] =\n{{\n' + ',\n'.join(rows) + '\n};')
+  else:
+    out.append(f'inline constexpr std::span<const ProfileEntry> {var};')
+  out.append('')
+
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument('--greeters', required=True, type=pathlib.Path)
+  parser.add_argument('--desktop', nargs='*', default=[], type=pathlib.Path, help='desktop profiles')
+  parser.add_argument('--tty', nargs='*', default=[], type=pathlib.Path, help='tty profiles')
+  parser.add_argument('--output', required=True, type=pathlib.Path)
+  args = parser.parse_args()
+
+  desktop = [read_profile(p, False) for p in sorted(args.desktop)]
+  tty = [read_profile(p, True) for p in sorted(args.tty)]
+  greeters = read_greeters(args.greeters)
+
+  check_unique(desktop + tty, 'profile')
+  check_unique(greeters, 'greeter')
+
+  if not tty:
+    fail('no tty profiles')
+
+  out = ['// Generated by profiles/compile_profiles.py, do not edit',
+         '#ifndef ALI_PROFILESDATA_H',
+         '#define ALI_PROFILESDATA_H',
+         '',
+         '#include <string_view>',
+         '#include <span>',
+         '',
+         'namespace profiles_data {',
+         '',
+         'struct CommandGroupEntry',
+         '{',
+         '  std::string_view name;',
+         '  bool user;',
+         '  bool parallel;',
+         '  std::span<const std::string_view> commands;',
+         '  std::span<const std::string_view> after;',
+         '};',
+         '',
+         'struct ProfileEntry',
+         '{',
+         '  std::string_view name;',
+         '  std::string_view info;',
+         '  bool is_tty;',
+         '  std::span<const std::string_view> packages;',
+         '  std::span<const std::string_view> system_commands;',
+         '  std::span<const std::string_view> user_commands;',
+         '  std::span<const CommandGroupEntry> command_groups;',
+         '};',
+         '']
+  
+  cpp_entries('Desktop', 'desktop', desktop, out)
+  cpp_entries('Tty', 'tty', tty, out)
+  cpp_entries('Greeters', 'greeter', greeters, out)
+
+  out += ['}', '', '#endif', '']
+
+  args.output.write_text('\n'.join(out))
+
+
+if __name__ == '__main__':
+  main()
@@ -8,6 +8,9 @@
 #include <ali/widgets/widgets.hpp>
 #include <ali/commands.hpp>
 #include <ali/common.hpp>
+#include <ali/sync_db.hpp>
+#include <ali/package_estimator.hpp>
+#include <ali/mirrors.hpp>
 
 
 static const QString log_format{"%{type} - %{if-debug}%{function} - %{endif}%{message}"};
@@ -64,10 +67,10 @@ bool check_commands_exist ()
   static const std::vector<std::string> Commands =
   {
     "pacman", "localectl", "locale-gen", "loadkeys", "setfont", "timedatectl", "ip", "lsblk", 
-    "mount", "swapon", "ln", "hwclock", "chpasswd", "passwd", "sgdisk", "useradd"
+    "mount", "swapon", "ln", "hwclock", "useradd", "blkdiscard", "tar", "zstd", "curl", "btrfs"
 
     #ifdef ALI_PROD
-      ,"pacstrap", "genfstab", "arch-chroot", "lshw"
+      ,"pacstrap", "arch-chroot", "lshw"
     #endif
   };
   
@@ -327,6 +330,13 @@ int main (int argc, char ** argv)
   }
   else
   {
+    // read package metadata while the user works through the pages
+    SyncDb::load_async();
+    PackageEstimator::measure_speed_async();
+    #ifdef ALI_PROD
+      Mirrors::rank_async();
+    #endif
+
     return app.exec();
   }
 }
@@ -0,0 +1,222 @@
+#include <ali/command_groups.hpp>
+#include <ali/commands.hpp>
+#include <fstream>
+#include <cstdio>
+#include <QDebug>
+
+
+// Not /tmp because arch-chroot mounts a tmpfs there
+static const fs::path ScriptsDir {"/var/tmp/ali/cmds"};
+static const std::string_view Marker {"@ali-result"};
+
+
+CommandGroupRunner::CommandGroupRunner(const fs::path& root, const std::string_view user, Log&& info, Log&& warning) :
+  m_root(root),
+  m_user(user),
+  m_info(std::move(info)),
+  m_warning(std::move(warning))
+{
+
+}
+
+
+std::optional<CommandGroupRunner::Waves> CommandGroupRunner::plan(const std::vector<CommandGroup>& groups)
+{
+  std::vector<bool> done(groups.size(), false);
+  std::size_t n_done{0};
+  Waves waves;
+
+  auto index_of = [&groups](const QString& name) -> std::optional<std::size_t>
+  {
+    for (std::size_t i = 0 ; i < groups.size() ; ++i)
+      if (groups[i].name == name)
+        return i;
+    return std::nullopt;
+  };
+
+  auto is_ready = [&](const std::size_t i)
+  {
+    return std::all_of(groups[i].after.cbegin(), groups[i].after.cend(), [&](const QString& name)
+    {
+      const auto dep = index_of(name);
+      return dep && done[*dep];
+    });
+  };
+
+  while (n_done < groups.size())
+  {
+    std::vector<std::size_t> wave;
+
+    // first ready group in declaration order: if not parallel, it runs alone,
+    // otherwise with all other ready parallel groups
+    for (std::size_t i = 0 ; i < groups.size() ; ++i)
+    {
+      if (done[i] || !is_ready(i))
+        continue;
+      
+      if (wave.empty() && !groups[i].parallel)
+      {
+        wave.push_back(i);
+        break;
+      }
+      else if (groups[i].parallel)
+        wave.push_back(i);
+    }
+
+    if (wave.empty())
+      return std::nullopt; // unknown 'after' or cycle
+    
+    for (const auto i : wave)
+      done[i] = true;
+    
+    n_done += wave.size();
+    waves.push_back(std::move(wave));
+  }
+
+  return waves;
+}
+
+
+bool CommandGroupRunner::run(const std::vector<CommandGroup>& groups)
+{
+  m_results.clear();
+
+  if (groups.empty())
+    return true;
+
+  const auto waves = plan(groups);
+  if (!waves)
+  {
+    m_warning("Command groups have an unknown or cyclic 'after'");
+    return false;
+  }
+
+  if (!write_scripts(groups, *waves))
+    return false;
+  
+  m_info(std::format("Running {} command groups in {} waves", groups.size(), waves->size()));
+
+  ChRootCmd chroot {m_root, std::format("bash {}", (ScriptsDir / "run.sh").string()), std::bind_front(&CommandGroupRunner::on_output, this)};
+  const bool ok = chroot.execute() == CmdSuccess;
+
+  for (const auto& result : m_results)
+  {
+    if (result.exit_code == 0)
+      m_info(std::format("[{}] '{}' succeeded in {}ms", result.group, result.command, result.duration.count()));
+    else if (result.exit_code < 0)
+      m_warning(std::format("[{}] '{}' did not run", result.group, result.command));
+    else
+      m_warning(std::format("[{}] '{}' failed with {} in {}ms", result.group, result.command, result.exit_code, result.duration.count()));
+  }
+  
+  std::error_code ec;
+  fs::remove_all(m_root / ScriptsDir.relative_path(), ec);
+
+  return ok;
+}
+
+
+bool CommandGroupRunner::write_scripts(const std::vector<CommandGroup>& groups, const Waves& waves)
+{
+  const fs::path dir = m_root / ScriptsDir.relative_path();
+  
+  std::error_code ec;
+  fs::remove_all(dir, ec);
+
+  if (fs::create_directories(dir, ec); ec)
+  {
+    m_warning(std::format("Failed to create {}: {}", dir.string(), ec.message()));
+    return false;
+  }
+
+  // user groups run as the user, so must be able to read the scripts
+  static const auto perms = fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec | fs::perms::others_read | fs::perms::others_exec;
+  fs::permissions(dir, perms, ec);
+  fs::permissions(dir.parent_path(), perms, ec);
+
+  auto script_name = [](const std::size_t i)
+  {
+    return std::format("group{}.sh", i);
+  };
+
+  // a script per group
+  for (std::size_t i = 0 ; i < groups.size() ; ++i)
+  {
+    const auto& group = groups[i];
+    const auto path = dir / script_name(i);
+
+    if (std::ofstream script{path}; !script.good())
+    {
+      m_warning(std::format("Failed to write {}", path.string()));
+      return false;
+    }
+    else
+    {
+      script << "#!/bin/bash\n";
+
+      for (const auto& command : group.commands)
+      {
+        // the result index is written, so interleaved output from concurrent groups doesn't matter
+        const auto result_index = m_results.size();
+
+        m_results.emplace_back(CommandResult{.group = group.name.toStdString(), .command = command.toStdString()});
+
+        script << "__ali_start=$(date +%s%N)\n";
+        script << command.toStdString() << '\n';
+        script << std::format("__ali_rc=$?; echo \"{} {} $__ali_rc $(( ($(date +%s%N) - __ali_start) / 1000000 ))\"\n", Marker, result_index);
+      }
+    }
+    
+    fs::permissions(path, perms, ec);
+  }
+
+  // master script, run in the chroot
+  const auto run_path = dir / "run.sh";
+
+  if (std::ofstream script{run_path}; !script.good())
+  {
+    m_warning(std::format("Failed to write {}", run_path.string()));
+    return false;
+  }
+  else
+  {
+    script << "#!/bin/bash\n";
+
+    for (const auto& wave : waves)
+    {
+      for (const auto i : wave)
+      {
+        const auto path = (ScriptsDir / script_name(i)).string();
+
+        if (!groups[i].user)
+          script << std::format("bash {} &\n", path);
+        else if (!m_user.empty())
+          script << std::format("su - {} -c 'bash {}' &\n", m_user, path);
+        else
+          m_warning(std::format("No user created, skipping user command group {}", groups[i].name.toStdString()));
+      }
+      script << "wait\n";
+    }
+  }
+
+  return true;
+}
+
+
+void CommandGroupRunner::on_output(const std::string_view line)
+{
+  if (line.starts_with(Marker))
+  {
+    std::size_t index{0};
+    int rc{0};
+    long long ms{0};
+
+    if (std::sscanf(std::string{line.substr(Marker.size())}.c_str(), "%zu %d %lld", &index, &rc, &ms) == 3 && index < m_results.size())
+    {
+      m_results[index].exit_code = rc;
+      m_results[index].duration = std::chrono::milliseconds{ms};
+    }
+  }
+  else
+    m_info(line);
+}
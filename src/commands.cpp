@@ -2,9 +2,48 @@
 #include <ali/common.hpp>
 #include <iostream>
 #include <functional>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <QDebug>
 
 
+// how often a running command checks for stop and its limits
+static constexpr std::chrono::milliseconds PollInterval {250};
+// after SIGTERM, time for the process group to exit before SIGKILL
+static constexpr std::chrono::seconds KillGrace {5};
+
+// set by the thread running commands, i.e. the install thread
+static thread_local std::stop_token t_stop_token;
+
+
+// SIGTERM then SIGKILL the command's process group, and reap the command
+static void terminate(const pid_t pid)
+{
+  ::kill(-pid, SIGTERM);
+
+  const auto until = std::chrono::steady_clock::now() + KillGrace;
+
+  while (std::chrono::steady_clock::now() < until)
+  {
+    if (::waitpid(pid, nullptr, WNOHANG) == pid)
+    {
+      // the command exited, its children may not have
+      ::kill(-pid, SIGKILL);
+      return;
+    }
+
+    std::this_thread::sleep_for(PollInterval);
+  }
+
+  ::kill(-pid, SIGKILL);
+  ::waitpid(pid, nullptr, 0);
+}
+
+
 // Command
 Command::Command ()
 {
@@ -38,47 +77,177 @@ int Command::execute (const std::string_view cmd, const int max_lines)
   if (cmd.empty())
     return CmdSuccess;
 
-  // redirect stderr to stdout (pacstrap, and perhaps others, output errors to stderr)
-  if (m_fd = ::popen(std::format("{} {}", cmd, "2>&1").data(), "r"); m_fd)
+  if (stop_requested())
+    return m_result = CmdCancelled;
+
+  int out[2];
+  if (::pipe2(out, O_CLOEXEC) != 0)
+    return m_result = CmdFail;
+
+  // prepared before fork(), the child only calls async-signal-safe functions
+  const std::string cmd_string {cmd};
+
+  const pid_t pid = ::fork();
+
+  if (pid < 0)
   {
-    char buff[4096];
-    int n_lines{0};
-    size_t n_chars{0};
-    
-    for (char c ; ((c = fgetc(m_fd)) != EOF) && n_chars < sizeof(buff); )
+    ::close(out[0]);
+    ::close(out[1]);
+    return m_result = CmdFail;
+  }
+  else if (pid == 0)
+  {
+    // A process group, so the command and its children (i.e. pacman within arch-chroot)
+    // are terminated together. stdin is /dev/null, so a command that prompts fails rather
+    // than waits. stderr to stdout (pacstrap, and perhaps others, output errors to stderr)
+    ::setpgid(0, 0);
+    ::signal(SIGPIPE, SIG_DFL);
+
+    if (const int null_fd = ::open("/dev/null", O_RDONLY); null_fd >= 0)
+      ::dup2(null_fd, STDIN_FILENO);
+
+    ::dup2(out[1], STDOUT_FILENO);
+    ::dup2(out[1], STDERR_FILENO);
+    ::execl("/bin/sh", "sh", "-c", cmd_string.c_str(), nullptr);
+    ::_exit(127);
+  }
+
+  // also in the parent, so the group exists before it can be killed
+  ::setpgid(pid, pid);
+  ::close(out[1]);
+
+  const auto start = std::chrono::steady_clock::now();
+  auto last_output = start;
+
+  char buff[4096];
+  char chunk[4096];
+  int n_lines{0};
+  size_t n_chars{0};
+  int reason{CmdSuccess};
+  bool done{false};
+
+  while (!done && !limit_reached(start, last_output, reason))
+  {
+    pollfd pfd {.fd = out[0], .events = POLLIN, .revents = 0};
+
+    if (const int r = ::poll(&pfd, 1, PollInterval.count()); r == 0 || (r < 0 && errno == EINTR))
+      continue;
+    else if (r < 0)
+      break;
+
+    const auto n = ::read(out[0], chunk, sizeof(chunk));
+
+    if (n < 0 && errno == EINTR)
+      continue;
+    else if (n <= 0)
+      break;  // end of output
+
+    // any output, i.e. a progress bar without a newline
+    last_output = std::chrono::steady_clock::now();
+
+    for (ssize_t i = 0 ; i < n && m_handler ; ++i)
     {
-      if (!m_handler)
-        continue;
-            
-      if (c == '\n')
+      if (chunk[i] == '\n')
       {
         m_handler(std::string_view {buff, n_chars});
+        n_chars = 0;
 
-        if (++n_lines == max_lines)
+        if (done = ++n_lines == max_lines; done)
           break;
-
-        n_chars = 0;
       }
-      else
+      else if (n_chars < sizeof(buff))  // long lines are truncated
       {
-        buff[n_chars++] = c;
+        buff[n_chars++] = chunk[i];
       }
     }
-    
-    if (m_handler && n_chars)
-      m_handler(std::string_view {buff, n_chars});
+  }
 
-    m_result = close();
+  // if max_lines reached, the command gets SIGPIPE if it writes more
+  ::close(out[0]);
+
+  if (m_handler && n_chars && !done)
+    m_handler(std::string_view {buff, n_chars});
+
+  if (reason == CmdSuccess)
+    m_result = wait(pid, start);
+  else
+  {
+    terminate(pid);
+    m_result = reason;
+  }
+
+  if (m_result == CmdCancelled)
+    qCritical() << "Command {" << cmd << "} cancelled";
+  else if (m_result == CmdTimeout)
+    qCritical() << "Command {" << cmd << "} timed out";
+  else if (m_result != CmdSuccess)
+    qCritical() << "Command {" << cmd << "} failed: " << m_result;
+
+  return m_result;
+}
 
-    if (m_result != CmdSuccess)
+
+// the output has ended, but the command may not have
+int Command::wait(const pid_t pid, const std::chrono::steady_clock::time_point start)
+{
+  int status{0};
+  int reason{CmdSuccess};
+
+  while (true)
+  {
+    if (const pid_t r = ::waitpid(pid, &status, WNOHANG); r == pid)
+      return status;
+    else if (r < 0 && errno != EINTR)
+      return CmdFail;
+    // no output is expected, so only the deadline and stop apply
+    else if (limit_reached(start, std::chrono::steady_clock::now(), reason))
     {
-      qCritical() << "Command {" << cmd << "} failed: " << ::strerror(m_result);
+      terminate(pid);
+      return reason;
     }
-    
-    return m_result;
+
+    std::this_thread::sleep_for(PollInterval);
   }
-  else
-    return CmdFail;
+}
+
+
+bool Command::limit_reached(const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point last_output, int& reason) const
+{
+  const auto now = std::chrono::steady_clock::now();
+
+  if (stop_requested())
+    reason = CmdCancelled;
+  else if (m_deadline.count() && now - start >= m_deadline)
+    reason = CmdTimeout;
+  else if (m_stall.count() && now - last_output >= m_stall)
+    reason = CmdTimeout;
+
+  return reason != CmdSuccess;
+}
+
+
+void Command::set_limits(const std::chrono::seconds deadline, const std::chrono::seconds stall)
+{
+  m_deadline = deadline;
+  m_stall = stall;
+}
+
+
+void Command::set_stop_token(std::stop_token token)
+{
+  t_stop_token = std::move(token);
+}
+
+
+std::stop_token Command::get_stop_token()
+{
+  return t_stop_token;
+}
+
+
+bool Command::stop_requested()
+{
+  return t_stop_token.stop_requested();
 }
 
 
@@ -256,6 +425,33 @@ QStringList TimezoneList::get_zones()
 }
 
 
+// DownloadSpeed
+DownloadSpeed::DownloadSpeed(const std::string_view url, const uint64_t bytes, const int timeout_secs) :
+  Command(std::format("curl -s -f -o /dev/null -r 0-{} --max-time {} -w \"%{{speed_download}} %{{time_starttransfer}}\\n\" {}", bytes-1, timeout_secs, url))
+{
+
+}
+
+uint64_t DownloadSpeed::get_speed()
+{
+  // curl exits with 28 on timeout but still reports speed, which is fine
+  execute([this](const std::string_view line)
+  {
+    // "<speed> <latency>"
+    if (!line.empty())
+    {
+      const std::string values{line};
+      char * end{nullptr};
+
+      m_speed = static_cast<uint64_t>(std::strtod(values.c_str(), &end));
+      m_latency = std::strtod(end, nullptr);
+    }
+  }, 1);
+
+  return m_speed;
+}
+
+
 // KeyMaps
 KeyMaps::KeyMaps() : Command("localectl list-keymaps")
 {
@@ -323,3 +519,4 @@ GpuVendor VideoVendor::get_vendor()
   
   return vendor;
 }
+
@@ -9,11 +9,8 @@
 #include <set>
 #include <QDebug>
 
-const fs::path HomeMnt{"/mnt/home"};
-//const fs::path BootMnt{"/mnt/boot"};
+// the root of a single install, see InstallTarget
 const fs::path RootMnt{"/mnt"};
-const fs::path EfiMnt{"/mnt/efi"};
-const fs::path FsTabPath{"/mnt/etc/fstab"};
 
 
 Partitions PartitionUtils::m_parts;
@@ -25,7 +22,7 @@ struct Probe
 {
   Probe(const std::string_view dev,
         const int part_flags = BLKID_PARTS_ENTRY_DETAILS,
-        const int super_block_flags = BLKID_SUBLKS_VERSION | BLKID_SUBLKS_FSINFO | BLKID_SUBLKS_TYPE)
+        const int super_block_flags = BLKID_SUBLKS_VERSION | BLKID_SUBLKS_FSINFO | BLKID_SUBLKS_TYPE | BLKID_SUBLKS_UUID)
   {
     if (pr = blkid_new_probe_from_filename(dev.data()); pr)
     {
@@ -59,12 +56,13 @@ bool PartitionUtils::do_probe(const ProbeOpts opts, const bool gpt_only)
 {
   qDebug() << "Enter";
 
-  m_parts.clear();
+  // probed without the lock, which is only held to replace the results
+  Partitions parts;
 
   const auto tree = create_tree();
 
   // for each disk, if partition table is GPT, read partition
-  for(const auto& [disk, parts] : tree)
+  for(const auto& [disk, disk_parts] : tree)
   {
     if (Probe probe{disk}; probe.valid())
     {
@@ -81,7 +79,9 @@ bool PartitionUtils::do_probe(const ProbeOpts opts, const bool gpt_only)
         if (gpt_only && !is_gpt)
           continue;
 
-        for (const auto& part_dev : parts)
+        const auto [dev_class, can_discard] = read_device_class(disk);
+
+        for (const auto& part_dev : disk_parts)
         {
           if (opts == ProbeOpts::UnMounted && is_dev_mounted(part_dev))
             continue;
@@ -90,21 +90,26 @@ bool PartitionUtils::do_probe(const ProbeOpts opts, const bool gpt_only)
           {
             partition.parent_dev = disk;
             partition.is_gpt = is_gpt;
+            partition.dev_class = dev_class;
+            partition.can_discard = can_discard;
 
             qInfo() << partition;
 
-            m_parts.push_back(std::move(partition));
+            parts.push_back(std::move(partition));
           }
         }
       }
     }
   }
 
-  std::sort(m_parts.begin(), m_parts.end(), [](const Partition& a, const Partition& b)
+  std::sort(parts.begin(), parts.end(), [](const Partition& a, const Partition& b)
   {
     return a.dev < b.dev;
   });
 
+  std::unique_lock lock{m_mutex};
+  m_parts = std::move(parts);
+
   qDebug() << "Leave";
   return true;
 }
@@ -168,6 +173,92 @@ PartitionUtils::Tree PartitionUtils::create_tree()
 }
 
 
+BlankDisks PartitionUtils::blank_disks()
+{
+  static const uint64_t SectorSize = 512; // sysfs size is always in 512 byte sectors
+
+  BlankDisks disks;
+
+  // the blkid cache doesn't reliably list devices without content, so use sysfs
+  for (const auto& entry : fs::directory_iterator{"/sys/block"})
+  {
+    // only physical devices have device/, this excludes loop, zram, dm, etc
+    if (!fs::exists(entry.path() / "device"))
+      continue;
+
+    const auto name = entry.path().filename().string();
+    const auto dev = "/dev/" + name;
+
+    uint64_t sectors{0}, read_only{0};
+
+    if (std::ifstream stream{entry.path() / "size"}; !(stream >> sectors) || !sectors)
+      continue;
+    
+    if (std::ifstream stream{entry.path() / "ro"}; stream >> read_only && read_only)
+      continue;
+
+    if (is_dev_mounted(dev))
+      continue;
+
+    if (Probe probe{dev}; probe.valid())
+    {
+      // 1 means nothing found: no partition table nor filesystem
+      if (blkid_do_safeprobe(probe.pr) == 1)
+      {
+        const auto [dev_class, can_discard] = read_device_class(dev);
+        disks.emplace_back(BlankDisk{.dev = dev, .size = sectors * SectorSize, .dev_class = dev_class});
+        
+        qInfo() << "Blank disk: " << dev << " size: " << sectors * SectorSize;
+      }
+    }
+  }
+
+  std::sort(disks.begin(), disks.end(), [](const BlankDisk& a, const BlankDisk& b)
+  {
+    return a.dev < b.dev;
+  });
+
+  return disks;
+}
+
+
+std::tuple<DeviceClass, bool> PartitionUtils::read_device_class(const std::string_view disk)
+{
+  // sysfs uses the kernel name, i.e. /dev/nvme0n1 -> /sys/block/nvme0n1
+  const auto name = fs::path{disk}.filename().string();
+  const fs::path queue = fs::path{"/sys/block"} / name / "queue";
+
+  auto read_value = [&queue](const std::string_view file) -> std::optional<uint64_t>
+  {
+    if (std::ifstream stream{queue / file}; stream.good())
+    {
+      uint64_t value{0};
+      if (stream >> value)
+        return value;
+    }
+    return std::nullopt;
+  };
+
+  DeviceClass dev_class{DeviceClass::Unknown};
+
+  if (const auto rotational = read_value("rotational"); rotational)
+  {
+    if (*rotational)
+      dev_class = DeviceClass::Hdd;
+    else
+      dev_class = name.starts_with("nvme") ? DeviceClass::Nvme : DeviceClass::Ssd;
+  }
+
+  // discard_max_bytes is 0 if the device does not support discard
+  const auto discard_max = read_value("discard_max_bytes");
+  const bool can_discard = discard_max && *discard_max > 0;
+
+  qInfo() << disk << " device class: " << device_class_name(dev_class) << ", discard: " << can_discard;
+
+  return {dev_class, can_discard};
+}
+
+
 std::tuple<PartitionStatus, Partition> PartitionUtils::probe_partition(const std::string_view part_dev)
 {
   static const unsigned SectorsPerPartSize = 512;
@@ -202,6 +293,13 @@ std::tuple<PartitionStatus, Partition> PartitionUtils::probe_partition(const std
       partition.fs_type = type;
     }
 
+    if (blkid_probe_has_value(pr, "UUID"))
+    {
+      const char * uuid {nullptr};
+      blkid_probe_lookup_value(pr, "UUID", &uuid, nullptr);
+      partition.uuid = uuid;
+    }
+
     if (blkid_probe_has_value(pr, "PART_ENTRY_SIZE"))
     {
       const char * part_size{nullptr};
@@ -247,8 +345,10 @@ std::tuple<PartitionStatus, Partition> PartitionUtils::probe_partition(const std
 }
 
 
-std::optional<std::reference_wrapper<const Partition>> PartitionUtils::get_partition(const std::string_view dev)
+std::optional<Partition> PartitionUtils::get_partition(const std::string_view dev)
 {
+  std::shared_lock lock{m_mutex};
+
   const auto it = std::find_if(std::cbegin(m_parts), std::cend(m_parts), [&dev](const Partition& part)
   {
     return part.dev == dev;
@@ -257,14 +357,14 @@ std::optional<std::reference_wrapper<const Partition>> PartitionUtils::get_parti
   if (it == std::cend(m_parts))
     return std::nullopt;
   else
-    return std::ref(*it);
+    return *it;
 }
 
 
 std::string PartitionUtils::get_partition_fs (const std::string_view dev)
 {
   if (const auto opt = get_partition(dev) ; opt)
-    return opt->get().fs_type;
+    return opt->fs_type;
   else
     return std::string{};
 }
@@ -273,16 +373,84 @@ std::string PartitionUtils::get_partition_fs (const std::string_view dev)
 std::string PartitionUtils::get_partition_parent (const std::string_view dev)
 {
   if (const auto opt = get_partition(dev) ; opt)
-    return opt->get().parent_dev;
+    return opt->parent_dev;
   else
     return std::string{};
 }
 
 
+DeviceClass PartitionUtils::get_partition_device_class (const std::string_view dev)
+{
+  if (const auto opt = get_partition(dev) ; opt)
+    return opt->dev_class;
+  else
+    return DeviceClass::Unknown;
+}
+
+
+bool PartitionUtils::get_partition_can_discard (const std::string_view dev)
+{
+  if (const auto opt = get_partition(dev) ; opt)
+    return opt->can_discard;
+  else
+    return false;
+}
+
+
+std::string PartitionUtils::get_partition_uuid (const std::string_view dev)
+{
+  if (const auto opt = get_partition(dev) ; opt)
+    return opt->uuid;
+  else
+    return std::string{};
+}
+
+
+bool PartitionUtils::refresh_partition(const std::string_view dev)
+{
+  if (!get_partition(dev))
+    return false;
+  
+  // probed without the lock, other targets' threads read their partitions meanwhile
+  if (auto [status, partition] = probe_partition(dev); status != PartitionStatus::Ok)
+    return false;
+  else
+  {
+    std::unique_lock lock{m_mutex};
+
+    const auto it = std::find_if(std::begin(m_parts), std::end(m_parts), [&dev](const Partition& part)
+    {
+      return part.dev == dev;
+    });
+
+    if (it == std::end(m_parts))
+      return false;
+
+    // retain what is set from the parent device
+    partition.parent_dev = it->parent_dev;
+    partition.is_gpt = it->is_gpt;
+    partition.dev_class = it->dev_class;
+    partition.can_discard = it->can_discard;
+
+    *it = std::move(partition);
+    return true;
+  }
+}
+
+
 int PartitionUtils::get_partition_part_number (const std::string_view dev)
 {
   if (const auto opt = get_partition(dev) ; opt)
-    return opt->get().part_number;
+    return opt->part_number;
+  else
+    return 0;
+}
+
+
+int64_t PartitionUtils::get_partition_size (const std::string_view dev)
+{
+  if (const auto opt = get_partition(dev) ; opt)
+    return opt->size;
   else
     return 0;
 }
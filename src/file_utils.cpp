@@ -0,0 +1,53 @@
+#include <ali/file_utils.hpp>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <QDebug>
+
+
+bool FileUtils::write_atomic(const fs::path& path, const std::string_view content, const fs::perms perms)
+{
+  const fs::path tmp_path {path.string() + ".ali-tmp"};
+
+  const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, static_cast<mode_t>(perms));
+  if (fd < 0)
+  {
+    qCritical() << "Failed to open " << tmp_path.string() << ": " << strerror(errno);
+    return false;
+  }
+
+  bool ok = true;
+
+  for (std::size_t written = 0 ; ok && written < content.size() ; )
+  {
+    if (const auto n = ::write(fd, content.data() + written, content.size() - written); n < 0)
+    {
+      if (errno != EINTR)
+        ok = false;
+    }
+    else
+      written += n;
+  }
+
+  // open() applies umask, so set explicitly
+  ok = ok && ::fchmod(fd, static_cast<mode_t>(perms)) == 0 && ::fsync(fd) == 0;
+  ok = (::close(fd) == 0) && ok;
+
+  if (ok && ::rename(tmp_path.c_str(), path.c_str()) != 0)
+    ok = false;
+  
+  if (!ok)
+  {
+    qCritical() << "Failed to write " << path.string() << ": " << strerror(errno);
+    ::unlink(tmp_path.c_str());
+  }
+  else if (const int dir_fd = ::open(path.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); dir_fd >= 0)
+  {
+    // persist the rename
+    ::fsync(dir_fd);
+    ::close(dir_fd);
+  }
+
+  return ok;
+}
@@ -0,0 +1,223 @@
+#include <ali/firmware_planner.hpp>
+#include <ali/commands.hpp>
+#include <ali/vm_plan.hpp>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <QDebug>
+
+
+static const std::string_view FirmwareDir {"/usr/lib/firmware/"};
+
+// Used if the live system doesn't have the split packages, by firmware path prefix. The
+// first match is used, a file without a match is in linux-firmware-other.
+static const std::vector<std::pair<std::string_view, std::string_view>> PackagePrefixes
+{
+  {"amdgpu/",   "linux-firmware-amdgpu"},
+  {"radeon/",   "linux-firmware-radeon"},
+  {"nvidia/",   "linux-firmware-nvidia"},
+  {"i915/",     "linux-firmware-intel"},
+  {"xe/",       "linux-firmware-intel"},
+  {"intel/",    "linux-firmware-intel"},
+  {"iwlwifi-",  "linux-firmware-intel"},
+  {"ath",       "linux-firmware-atheros"},  // ath10k/, ath11k/, ath3k-1.fw, etc
+  {"qca/",      "linux-firmware-atheros"},
+  {"brcm/",     "linux-firmware-broadcom"},
+  {"cirrus/",   "linux-firmware-cirrus"},
+  {"mediatek/", "linux-firmware-mediatek"},
+  {"mrvl/",     "linux-firmware-marvell"},
+  {"rtl",       "linux-firmware-realtek"},  // rtl_nic/, rtl_bt/, rtlwifi/
+  {"rtw8",      "linux-firmware-realtek"},  // rtw88/, rtw89/
+  {"mellanox/", "linux-firmware-mellanox"},
+  {"qcom/",     "linux-firmware-qcom"}
+};
+
+static constexpr std::string_view OtherPackage {"linux-firmware-other"};
+
+
+std::string FirmwarePlan::summary() const
+{
+  if (!hypervisor.empty())
+    return std::format("Virtual machine ({}): no firmware required", hypervisor);
+  else if (!detected)
+    return "Could not detect devices: all firmware is installed";
+  else if (packages.isEmpty())
+    return std::format("No firmware required by the {} device drivers", n_modules);
+  else
+    return std::format("Firmware for {} device drivers", n_modules);
+}
+
+
+FirmwarePlan FirmwarePlanner::plan()
+{
+  FirmwarePlan plan;
+
+  if (const auto& vm = VmPlan::get(); vm.is_vm())
+  {
+    plan.hypervisor = vm.name();
+    plan.detected = true;
+    return plan;
+  }
+
+  const auto modules = device_modules();
+
+  if (modules.empty())
+  {
+    qWarning() << "No device modules found, using all firmware";
+    plan.packages.append(FullPackage);
+    return plan;
+  }
+
+  const auto files = module_firmware(modules);
+  const auto owners = live_file_owners();
+
+  std::set<std::string> packages;
+  for (const auto& file : files)
+  {
+    if (const auto package = package_for(file, owners); !package.empty())
+      packages.insert(package);
+  }
+
+  for (const auto& package : packages)
+    plan.packages.append(QString::fromStdString(package));
+
+  plan.detected = true;
+  plan.n_modules = modules.size();
+
+  qInfo() << "Firmware: " << plan.summary() << ": " << plan.packages;
+
+  return plan;
+}
+
+
+std::set<std::string> FirmwarePlanner::device_modules()
+{
+  std::set<std::string> modules;
+  std::stringstream aliases;
+
+  for (const fs::path bus : {"/sys/bus/pci/devices", "/sys/bus/usb/devices"})
+  {
+    std::error_code ec;
+    for (const auto& device : fs::directory_iterator{bus, ec})
+    {
+      // driver/module doesn't exist for built-in drivers
+      if (const auto module = fs::canonical(device.path() / "driver" / "module", ec); !ec)
+        modules.insert(module.filename().string());
+      else if (std::string alias; std::ifstream{device.path() / "modalias"} >> alias)
+        aliases << " '" << alias << '\'';
+    }
+  }
+
+  // no driver bound, i.e. blacklisted on the live system: the module that would be loaded
+  if (const auto list = aliases.str(); !list.empty())
+  {
+    Command resolve{std::format("for alias in{}; do modprobe -R \"$alias\" 2>/dev/null; done", list), [&modules](const std::string_view out)
+    {
+      if (!out.empty())
+        modules.insert(std::string{out});
+    }};
+
+    resolve.execute();
+  }
+
+  return modules;
+}
+
+
+std::set<std::string> FirmwarePlanner::module_firmware(const std::set<std::string>& modules)
+{
+  std::set<std::string> files;
+
+  std::stringstream cmd_string;
+  cmd_string << "modinfo -F firmware";
+
+  for (const auto& module : modules)
+    cmd_string << ' ' << module;
+
+  Command modinfo{cmd_string.str(), [&files](const std::string_view out)
+  {
+    // errors for modules that don't exist
+    if (!out.empty() && !out.starts_with("modinfo:"))
+      files.insert(std::string{out});
+  }};
+
+  modinfo.execute();
+
+  return files;
+}
+
+
+FirmwarePlanner::FileOwners FirmwarePlanner::live_file_owners()
+{
+  std::string packages;
+
+  Command installed{"pacman -Qq", [&packages](const std::string_view out)
+  {
+    // linux-firmware-whence has the licences
+    if (out.starts_with("linux-firmware-") && out != "linux-firmware-whence")
+      packages.append(" ").append(out);
+  }};
+
+  if (installed.execute() != CmdSuccess || packages.empty())
+    return {};
+
+  FileOwners owners;
+
+  Command files{std::format("pacman -Ql{}", packages), [&owners](const std::string_view out)
+  {
+    // "<package> <path>", directories end with '/'
+    const auto space = out.find(' ');
+
+    if (space == std::string_view::npos || out.ends_with('/'))
+      return;
+
+    auto path = out.substr(space + 1);
+
+    if (!path.starts_with(FirmwareDir))
+      return;
+
+    path.remove_prefix(FirmwareDir.size());
+
+    for (const std::string_view ext : {".zst", ".xz"})
+    {
+      if (path.ends_with(ext))
+        path.remove_suffix(ext.size());
+    }
+
+    owners.emplace(path, out.substr(0, space));
+  }};
+
+  files.execute();
+
+  return owners;
+}
+
+
+// A module can list firmware that isn't packaged (i.e. for hardware not released), which
+// is skipped. Some use a wildcard, i.e. "iwlwifi-*.ucode".
+std::string FirmwarePlanner::package_for(const std::string_view file, const FileOwners& owners)
+{
+  const auto star = file.find('*');
+  const auto prefix = file.substr(0, star);
+
+  if (!owners.empty())
+  {
+    if (star == std::string_view::npos)
+    {
+      const auto it = owners.find(file);
+      return it == owners.end() ? std::string{} : it->second;
+    }
+    else
+    {
+      const auto it = owners.lower_bound(prefix);
+      return it == owners.end() || !it->first.starts_with(prefix) ? std::string{} : it->second;
+    }
+  }
+
+  const auto it = std::find_if(PackagePrefixes.cbegin(), PackagePrefixes.cend(), [prefix](const auto& entry)
+  {
+    return prefix.starts_with(entry.first);
+  });
+
+  return std::string{it == PackagePrefixes.cend() ? OtherPackage : it->second};
+}
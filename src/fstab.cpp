@@ -0,0 +1,177 @@
+#include <ali/fstab.hpp>
+#include <ali/disk_utils.hpp>
+#include <ali/file_utils.hpp>
+#include <libmount/libmount.h>
+#include <sstream>
+#include <cstring>
+#include <QDebug>
+
+
+static const FsTabPolicy DefaultPolicy { .fs = "", .remove = {}, .append = {}, .pass = 2 };
+
+static const std::vector<FsTabPolicy> Policies =
+{
+  // subvolid changes if the subvolume is recreated, subvol (path) does not. 
+  // btrfs doesn't use fsck at boot
+  FsTabPolicy { .fs = "btrfs", .remove = {"subvolid"}, .append = {}, .pass = 0 },
+  FsTabPolicy { .fs = "ext4", .remove = {}, .append = {}, .pass = 2 },
+  FsTabPolicy { .fs = "vfat", .remove = {}, .append = {}, .pass = 2 }
+};
+
+
+bool FsTab::write(const fs::path& root, const fs::path& fstab_path, const std::vector<fs::path>& exclude,
+                  const SessionOptions& session)
+{
+  auto entries = read_mounts(root);
+
+  std::erase_if(entries, [&root, &exclude](const Entry& entry)
+  {
+    return std::find(exclude.begin(), exclude.end(), root / fs::path{entry.target}.relative_path()) != exclude.end();
+  });
+
+  if (entries.empty())
+  {
+    qCritical() << "No filesystems mounted under " << root.string();
+    return false;
+  }
+  
+  for (auto& entry : entries)
+  {
+    // the probe data is from before the filesystem was created, so refresh
+    // if the UUID is missing (refresh has no effect if the partition wasn't probed)
+    if (entry.uuid = PartitionUtils::get_partition_uuid(entry.source); entry.uuid.empty())
+    {
+      PartitionUtils::refresh_partition(entry.source);
+      entry.uuid = PartitionUtils::get_partition_uuid(entry.source);
+    }
+
+    if (entry.uuid.empty())
+      qWarning() << "No UUID for " << entry.source << ", using device path in fstab";
+
+    if (const auto it = session.find(entry.target); it != session.end())
+    {
+      const std::vector<std::string_view> names {it->second.cbegin(), it->second.cend()};
+      entry.options = apply_policy(FsTabPolicy{.fs = entry.fs, .remove = names}, entry.options);
+    }
+  }
+
+  std::error_code ec;
+  fs::create_directories(fstab_path.parent_path(), ec);
+
+  return FileUtils::write_atomic(fstab_path, create_content(entries));
+}
+
+
+std::vector<FsTab::Entry> FsTab::read_mounts(const fs::path& root)
+{
+  std::vector<Entry> entries;
+
+  const std::string root_path = root.string();
+
+  auto installed_target = [&root_path](const std::string_view target) -> std::optional<std::string>
+  {
+    if (target == root_path)
+      return "/";
+    else if (target.starts_with(root_path) && target.size() > root_path.size() && target[root_path.size()] == '/')
+      return std::string{target.substr(root_path.size())};
+    else
+      return std::nullopt;
+  };
+
+
+  if (auto table = mnt_new_table(); table)
+  {
+    if (mnt_table_parse_mtab(table, nullptr) != 0)
+      qCritical() << "Failed to parse mount table";
+    else if (auto itr = mnt_new_iter(MNT_ITER_FORWARD); itr)
+    {
+      libmnt_fs * mnt_fs {nullptr};
+
+      while (mnt_table_next_fs(table, itr, &mnt_fs) == 0)
+      {
+        const char * target = mnt_fs_get_target(mnt_fs);
+        const char * source = mnt_fs_get_srcpath(mnt_fs);  // null for pseudo filesystems
+        const char * fs_type = mnt_fs_get_fstype(mnt_fs);
+        const char * options = mnt_fs_get_options(mnt_fs);
+
+        if (!target || !source || !fs_type || !std::string_view{source}.starts_with("/dev/"))
+          continue;
+
+        if (const auto installed = installed_target(target); installed)
+        {
+          const auto& policy = get_policy(fs_type);
+
+          Entry entry { .source = source,
+                        .target = *installed,
+                        .fs = fs_type,
+                        .options = apply_policy(policy, options ? options : "defaults"),
+                        .dump = 0,
+                        .pass = policy.pass == 0 ? 0 : (*installed == "/" ? 1 : policy.pass)};
+          
+          qInfo() << "fstab: " << entry.source << " " << entry.target << " " << entry.fs << " " << entry.options;
+
+          entries.emplace_back(std::move(entry));
+        }
+      }
+
+      mnt_free_iter(itr);
+    }
+
+    mnt_free_table(table);
+  }
+
+  return entries;
+}
+
+
+const FsTabPolicy& FsTab::get_policy(const std::string_view fs)
+{
+  const auto it = std::find_if(Policies.cbegin(), Policies.cend(), [fs](const FsTabPolicy& p) { return p.fs == fs; });
+  return it == Policies.cend() ? DefaultPolicy : *it;
+}
+
+
+std::string FsTab::apply_policy(const FsTabPolicy& policy, const std::string_view options)
+{
+  // libmount's optstr functions realloc()
+  char * optstr = strndup(options.data(), options.size());
+
+  for (const auto name : policy.remove)
+    mnt_optstr_remove_option(&optstr, std::string{name}.c_str());
+
+  for (const auto option : policy.append)
+  {
+    // option may be "name=value"
+    const auto eq = option.find('=');
+    const std::string name {option.substr(0, eq)};
+    const std::string value {eq == std::string_view::npos ? "" : option.substr(eq+1)};
+
+    if (mnt_optstr_get_option(optstr, name.c_str(), nullptr, nullptr) != 0)
+      mnt_optstr_append_option(&optstr, name.c_str(), value.empty() ? nullptr : value.c_str());
+  }
+
+  std::string result {optstr ? optstr : "defaults"};
+  free(optstr);
+
+  return result.empty() ? "defaults" : result;
+}
+
+
+std::string FsTab::create_content(const std::vector<Entry>& entries)
+{
+  std::stringstream ss;
+
+  ss << "# Static information about the filesystems.\n";
+  ss << "# See fstab(5) for details.\n\n";
+  ss << "# <file system> <dir> <type> <options> <dump> <pass>\n";
+
+  for (const auto& entry : entries)
+  {
+    ss << "# " << entry.source << '\n';
+    ss << (entry.uuid.empty() ? entry.source : "UUID=" + entry.uuid) << '\t';
+    ss << entry.target << '\t' << entry.fs << '\t' << entry.options << '\t';
+    ss << entry.dump << ' ' << entry.pass << "\n\n";
+  }
+
+  return ss.str();
+}
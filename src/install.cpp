@@ -1,56 +1,94 @@
 #include <ali/install.hpp>
 #include <ali/disk_utils.hpp>
+#include <ali/fstab.hpp>
+#include <ali/install_session.hpp>
+#include <ali/command_groups.hpp>
+#include <ali/unit_enabler.hpp>
+#include <ali/shadow.hpp>
+#include <ali/system_image.hpp>
+#include <ali/shared_install.hpp>
+#include <ali/mirrors.hpp>
+#include <ali/pacman_conf.hpp>
+#include <ali/pacman_hooks.hpp>
+#include <ali/package_estimator.hpp>
 #include <ali/locale_utils.hpp>
+#include <ali/vm_plan.hpp>
+#include <ali/file_utils.hpp>
 #include <ali/packages.hpp>
 #include <ali/profiles.hpp>
 #include <ali/widgets/widgets.hpp>
 #include <sstream>
 #include <string>
 #include <fstream>
+#include <future>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <QDebug>
 
 // temp mounts: partitions are mounted before running GRUB's os-prober
 static const fs::path TmpMountPath {"/tmp/ali/mnt"};
-static std::vector<std::string> temp_mounts;
+// btrfs partitions are mounted here, per partition, to create subvolumes
+static const fs::path FormatMountPath {"/tmp/ali/format"};
+
+static const QStringList BootPackages {"grub", "efibootmgr", "os-prober"};
+static const QString ZramPackage {"zram-generator"};
+// grub-mkconfig runs os-prober, which can hang on a bad partition
+static constexpr std::chrono::minutes GrubDeadline {5};
 
 
 
 void Install::log_stage_start(const std::string_view stage)
 {
-  qInfo() << "Stage start: " << stage;
+  qInfo() << "Stage start: " << with_target(stage);
   emit on_stage_start(QString::fromLocal8Bit(stage.data(), stage.size()));
 }
 
 void Install::log_stage_end(const std::string_view stage)
 {
-  qInfo() << "Stage end: " << stage;
+  qInfo() << "Stage end: " << with_target(stage);
   emit on_stage_end(QString::fromLocal8Bit(stage.data(), stage.size()));
 }
 
 void Install::log_critical(const std::string_view msg)
 {
-  qCritical() << msg;
+  qCritical() << with_target(msg);
   emit on_log_critical(QString::fromLocal8Bit(msg.data(), msg.size()));
 }
 
 void Install::log_warning(const std::string_view msg)
 {
-  qWarning() << msg;
+  qWarning() << with_target(msg);
   emit on_log_warning(QString::fromLocal8Bit(msg.data(), msg.size()));
 }
 
 void Install::log_info(const std::string_view msg)
 {
-  qInfo() << msg;
+  qInfo() << with_target(msg);
   emit on_log_info(QString::fromLocal8Bit(msg.data(), msg.size()));
 }
 
+// the log file is shared by concurrent installs
+std::string Install::with_target(const std::string_view msg) const
+{
+  return m_target.is_multi() ? std::format("{}: {}", m_target.name(), msg) : std::string{msg};
+}
+
 
-void Install::install ()
+void Install::install (const InstallTarget& target, const MountData& mounts, const InstallMode mode,
+                        const fs::path& image_dir, SharedInstall * shared)
 {
   auto exec_stage = [this](std::function<bool(Install&)> f, const std::string_view stage) mutable
   {
+    if (Command::stop_requested())
+    {
+      log_stage_end(std::format("{} - Cancelled", stage));
+      return false;
+    }
+
     log_stage_start(std::format("{} - Start", stage));
     
     const bool ok = f(std::ref(*this));
@@ -58,309 +96,1261 @@ void Install::install ()
     log_stage_end(std::format("{} - {}", stage, ok ? "Success" : "Fail"));
     return ok;
   };
+
+  // skipped if the journal has it, otherwise recorded in the journal when it succeeds
+  auto exec_journaled = [this, &exec_stage](std::function<bool(Install&)> f, const std::string_view stage)
+  {
+    if (m_journal.is_complete(stage))
+    {
+      log_stage_end(std::format("{} - Completed previously", stage));
+      return true;
+    }
+
+    const bool ok = exec_stage(f, stage);
+
+    // a cancelled stage may return true, i.e. extras which tolerate failed commands
+    if (ok && m_journal.is_open() && !Command::stop_requested())
+    {
+      // the stage's changes must be on disk before the journal says it's complete
+      sync_target();
+
+      if (!m_journal.complete(stage, stage_inputs(stage)))
+        log_warning("Failed to update the install journal, a resume will repeat this stage");
+    }
+
+    return ok;
+  };
   
   // TODO should probably have: exec_required() and exec_can_fail()
   //      because minimal operations must all suceed, but 'extra' can
   //      fail, so no need to return bool type
 
+  m_target = target;
+  m_mounts = mounts;
+  m_shared = shared;
+  m_shared_arrived = false;
+  m_mode = mode;
+  m_image_dir = image_dir;
+  m_root_received = false;
+  m_journal.close();
+  m_hooks_deferred = false;
+  m_session_options.clear();
+
+  // until the end of the install, concurrent installs share it
+  InstallSession session;
+
   try
   {
-    const bool minimal =  exec_stage(&Install::filesystems, "filesystems") &&
-                          exec_stage(&Install::mount, "mount") &&
-                          exec_stage(&Install::pacman_strap, "pacstrap") &&
-                          exec_stage(&Install::swap, "swap") &&
-                          exec_stage(&Install::fstab, "fstab") &&                          
-                          exec_stage(&Install::network, "network") &&
-                          exec_stage(&Install::root_account, "root account") &&
-                          exec_stage(&Install::user_account, "user account") &&
-                          exec_stage(&Install::boot_loader, "bootloader");
+    const bool resume = m_mode == InstallMode::Resume;
+
+    // resuming keeps the filesystems, the journal is on them
+    if (resume)
+      m_mounts.root.create_fs = m_mounts.efi.create_fs = m_mounts.home.create_fs = false;
+
+    const bool mounted =  resume ? exec_stage(&Install::mount, "mount") &&
+                                   exec_stage(&Install::resume_journal, "resume") :
+                                   exec_stage(&Install::filesystems, "filesystems") &&
+                                   exec_stage(&Install::mount, "mount");
+
+    if (mounted && !resume)
+      begin_journal();
+
+    // after resume, which has the mode
+    if (mounted)
+      defer_hooks();
+
+    // concurrent installs wait here for each other
+    if (m_shared)
+      share_cache(mounted);
+
+    // a deployed image already has the packages, so only the per machine stages run.
+    // When resuming, the mode is from the journal
+    const bool deploy = m_mode == InstallMode::Deploy;
+    const bool vm = VmPlan::get().is_vm();
+
+    const bool minimal =  mounted &&
+                          (deploy ? exec_journaled(&Install::deploy_image, "deploy image") :
+                                    exec_journaled(&Install::pacman_strap, "pacstrap")) &&
+                          (!vm || exec_journaled(&Install::virtual_machine, "virtual machine")) &&
+                          exec_journaled(&Install::swap, "swap") &&
+                          exec_journaled(&Install::fstab, "fstab") &&                          
+                          exec_journaled(&Install::network, "network") &&
+                          exec_journaled(&Install::root_account, "root account") &&
+                          exec_journaled(&Install::user_account, "user account") &&
+                          exec_journaled(&Install::boot_loader, "bootloader") &&
+                          // a deployed image has nothing more to install, so it's bootable once synced
+                          (!deploy || exec_stage(&Install::end_session, "sync"));
     
-    emit on_complete(minimal ? CompleteStatus::MinimalSuccess : CompleteStatus::MinimalFail);
-
-    if (minimal)
+    if (!minimal)
+      emit on_complete(CompleteStatus::MinimalFail);
+    else if (deploy)
+    {
+      // shell, profile, packages, video and locale are in the image
+      emit on_complete(CompleteStatus::MinimalSuccess);
+      emit on_complete(CompleteStatus::ExtraSuccess);
+    }
+    else
     {
       // if any of these fail, they still return true because it is not a show stopper
       
       // TODO additional packages
 
       // shell is extra because 'bash' is installed as part of 'base'
-      const bool extra =  exec_stage(&Install::shell, "shell") &&
-                          exec_stage(&Install::profile, "profile") &&
-                          exec_stage(&Install::packages, "packages") &&
-                          exec_stage(&Install::gpu, "video") &&
-                          exec_stage(&Install::localise, "locale");
-      
-      emit on_complete(extra ? CompleteStatus::ExtraSuccess : CompleteStatus::ExtraFail);
+      bool extra =  exec_journaled(&Install::shell, "shell") &&
+                    exec_journaled(&Install::profile, "profile") &&
+                    exec_journaled(&Install::packages, "packages") &&
+                    exec_journaled(&Install::gpu, "video") &&
+                    exec_journaled(&Install::localise, "locale");
+
+      // even if extras failed: the deferred hooks create the initramfs and grub.cfg, then
+      // the boot files are synced and verified. Until then the minimal install won't boot
+      const bool bootable = (!m_hooks_deferred || exec_journaled(&Install::pacman_hooks, "pacman hooks")) &&
+                            exec_stage(&Install::end_session, "sync");
+
+      if (!bootable)
+        emit on_complete(CompleteStatus::MinimalFail);
+      else
+      {
+        emit on_complete(CompleteStatus::MinimalSuccess);
+
+        // only capture a complete install
+        if (extra && m_mode == InstallMode::Capture)
+          extra = exec_journaled(&Install::capture_image, "capture image");
+        
+        emit on_complete(extra ? CompleteStatus::ExtraSuccess : CompleteStatus::ExtraFail);
+      }
     }
   }
   catch(const std::exception& e)
   {
     log_critical(e.what());
   }
-  catch (...)
+  catch (...)
+  {
+    log_critical("Install encountered an unknown exception");
+  }
+
+  // other targets would wait forever
+  if (m_shared && !m_shared_arrived)
+    m_shared->arrive(m_target, false, {});
+
+  if (!m_cache_bind.empty())
+    ::umount(m_cache_bind.c_str());
+
+  // a failed or cancelled install, a resume defers them again
+  if (m_hooks_deferred)
+    PacmanHooks::restore(m_target.root);
+
+  if (Command::stop_requested())
+    cancelled();
+}
+
+
+// btrfs subvolumes are created with the partition mounted here, rather than the target's root/home,
+// so concurrent format tasks don't mount within each other
+static fs::path format_mount_path(const std::string_view part_dev)
+{
+  return FormatMountPath / fs::path{part_dev}.filename();
+}
+
+
+// filesystems
+bool Install::filesystems()
+{
+  const auto& mounts = m_mounts;
+
+  // sanity: UI should prevent this
+  if (mounts.root.dev.empty() || mounts.efi.dev.empty() || mounts.home.dev.empty())
+  {
+    log_critical("Mounts are invalid");
+    return false;
+  }
+
+  const bool create_home_partition = mounts.home.create_fs && mounts.home.dev != mounts.root.dev;
+  const bool create_home_subvolume = mounts.home.dev == mounts.root.dev && mounts.root.fs == "btrfs";
+
+  // A task per parent device: partitions on the same device are formatted sequentially,
+  // partitions on different devices are formatted concurrently. The partition type is
+  // set by the task because it writes the device's partition table.
+  using FormatSteps = std::vector<std::function<bool()>>;
+  std::map<std::string, FormatSteps> tasks;
+
+  auto add_step = [&tasks](const std::string& part_dev, std::function<bool()>&& step)
+  {
+    const auto parent = PartitionUtils::get_partition_parent(part_dev);
+    tasks[parent.empty() ? part_dev : parent].emplace_back(std::move(step));
+  };
+
+  // wipefs, discard (SSD/NVMe), create new fs then set partition type for root, boot and home if applicable
+  if (mounts.root.create_fs)
+  {
+    add_step(mounts.root.dev, [this, &mounts, create_home_subvolume]
+    {
+      if (!wipe_fs(mounts.root.dev))
+        return false;
+
+      const bool discarded = discard(mounts.root.dev);
+      bool ok{false};
+
+      if (mounts.root.fs == "btrfs")
+      {
+        ok = create_btrfs_filesystem(mounts.root.dev, format_mount_path(mounts.root.dev), MountType::Root, discarded);
+
+        // create subvol for @home, which is mounted to root
+        if (ok && create_home_subvolume)
+          ok = create_btrfs_subvolume(mounts.root.dev, format_mount_path(mounts.root.dev), "@home");
+      }
+      else
+        ok = create_filesystem(mounts.root.dev, mounts.root.fs, discarded);
+
+      if (ok)
+        set_partition_type<LinuxRootType>(mounts.root.dev);
+
+      return ok;
+    });
+  }
+  
+  if (mounts.efi.create_fs)
+  {
+    add_step(mounts.efi.dev, [this, &mounts]
+    {
+      const bool ok = wipe_fs(mounts.efi.dev) && create_filesystem(mounts.efi.dev, mounts.efi.fs, discard(mounts.efi.dev));
+      
+      if (ok)
+        set_partition_type<EfiType>(mounts.efi.dev);
+
+      return ok;
+    });
+  }
+  
+  if (create_home_partition)
+  {
+    add_step(mounts.home.dev, [this, &mounts]
+    {
+      if (!wipe_fs(mounts.home.dev))
+        return false;
+      
+      const bool discarded = discard(mounts.home.dev);
+      bool ok{false};
+
+      if (mounts.home.fs == "btrfs")
+        ok = create_btrfs_filesystem(mounts.home.dev, format_mount_path(mounts.home.dev), MountType::Home, discarded);
+      else
+        ok = create_filesystem(mounts.home.dev, mounts.home.fs, discarded);
+
+      if (ok)
+        set_partition_type<LinuxHomeType>(mounts.home.dev);
+
+      return ok;
+    });
+  }
+
+  
+  std::vector<std::future<bool>> results;
+  results.reserve(tasks.size());
+
+  for (auto& [parent_dev, steps] : tasks)
+  {
+    log_info(std::format("Formatting {} partition(s) on {}", steps.size(), parent_dev));
+
+    results.emplace_back(std::async(std::launch::async, [&steps, stop = Command::get_stop_token()]
+    {
+      Command::set_stop_token(stop);
+
+      // stop at first failure on this device
+      return std::all_of(steps.begin(), steps.end(), [](const auto& step){ return step(); });
+    }));
+  }
+
+  // wait for all, even if one fails, so we don't leave mkfs running
+  bool ok{true};
+  for (auto& result : results)
+    ok = result.get() && ok;
+
+  // new filesystems have new UUIDs, required for fstab
+  for (const auto& mount : {mounts.root, mounts.efi, mounts.home})
+  {
+    if (mount.create_fs && !PartitionUtils::refresh_partition(mount.dev))
+      log_warning(std::format("Failed to probe {} after creating filesystem", mount.dev));
+  }
+
+  return ok;
+}
+
+
+bool Install::wipe_fs(const std::string_view dev)
+{
+  log_info(std::format("Wiping filesystem on {}", dev));
+  Command wipe {std::format ("wipefs -a -f {}", dev)};
+  return wipe.execute() == CmdSuccess;
+}
+
+
+bool Install::discard(const std::string_view dev)
+{
+  // only worth it on SSD/NVMe: the drive then knows every block is free, and
+  // mkfs can skip its own discard pass. Failure is not an error, mkfs just
+  // uses the default options
+  const DeviceClass dev_class = PartitionUtils::get_partition_device_class(dev);
+
+  if (dev_class == DeviceClass::Hdd || dev_class == DeviceClass::Unknown)
+    return false;
+  else if (!PartitionUtils::get_partition_can_discard(dev))
+  {
+    log_info(std::format("{} does not support discard", dev));
+    return false;
+  }
+  else
+  {
+    log_info(std::format("Discarding {} ({})", dev, device_class_name(dev_class)));
+
+    if (DiscardDevice cmd{dev}; cmd.execute() != CmdSuccess)
+    {
+      log_warning(std::format("Discard failed on {}. This is not an error", dev));
+      return false;
+    }
+
+    return true;
+  }
+}
+
+
+bool Install::create_btrfs_filesystem(const std::string_view part_dev, const fs::path mount, const MountType type, const bool discarded)
+{
+  // for btrfs, we make btrfs, mount it without options, create subvolume, then unmount.
+  // the mount step following this function will mount with appropriate btrfs options
+  // so that fstab is created correctly
+
+  bool ok{false};
+
+  log_info(std::format("Creating btrfs on {}", part_dev));
+
+  if (type == MountType::Esp)
+    log_critical("Invalid mount type for BTRFS volume. Must be home or root");
+  else
+  {
+    const DeviceClass dev_class = PartitionUtils::get_partition_device_class(part_dev);
+
+    if (CreateBtrFs cmd{part_dev, dev_class, discarded}; cmd.execute() != CmdSuccess)
+      ok = false;
+    else if (type == MountType::Root && m_mode == InstallMode::Deploy && SystemImage::has_send_stream(m_image_dir))
+      ok = m_root_received = receive_btrfs_root(part_dev, mount);
+    else
+      ok = create_btrfs_subvolume(part_dev, mount, type == MountType::Root ? "@" : "@home");
+  }
+
+  return ok;
+}
+
+
+bool Install::create_btrfs_subvolume(const std::string_view part_dev, const fs::path mount, const std::string_view subvolume)
+{
+  log_info(std::format("Creating subvolume {} on {}", subvolume, mount.string()));
+
+  bool ok {false};
+
+  if (std::error_code ec; !fs::create_directories(mount, ec) && ec)
+    log_critical(std::format("Failed to create {}: {}", mount.string(), ec.message()));
+  else if (do_mount(part_dev, mount.string(), "btrfs", no_fs_opts{}))
+  {
+    CreateBtrVolume cmd_volume{mount, subvolume};
+    ok =  cmd_volume.execute() == CmdSuccess &&
+          ::umount(mount.string().data()) == 0;
+  }
+
+  return ok;
+}
+
+
+// a deployed image with a btrfs send stream: receive it as @ rather than creating an empty @
+bool Install::receive_btrfs_root(const std::string_view part_dev, const fs::path mount)
+{
+  SystemImage image{[this](const std::string_view msg){ log_info(msg); }, [this](const std::string_view msg){ log_warning(msg); }};
+
+  bool ok {false};
+
+  if (std::error_code ec; !fs::create_directories(mount, ec) && ec)
+    log_critical(std::format("Failed to create {}: {}", mount.string(), ec.message()));
+  else if (do_mount(part_dev, mount.string(), "btrfs", no_fs_opts{}))
+  {
+    ok = image.receive(m_image_dir, mount, "@");
+    ok = ::umount(mount.string().data()) == 0 && ok;
+  }
+
+  if (!ok)
+    log_critical(std::format("Failed to receive root subvolume on {}", part_dev));
+
+  return ok;
+}
+
+
+bool Install::create_filesystem(const std::string_view part_dev, const std::string_view fs, const bool discarded)
+{
+  const DeviceClass dev_class = PartitionUtils::get_partition_device_class(part_dev);
+
+  log_info(std::format("Creating {} on {} ({})", fs, part_dev, device_class_name(dev_class)));
+
+  int res {CmdFail};
+  
+  if (fs == "ext4")
+  {
+    CreateExt4 cmd{part_dev, dev_class, discarded};
+    res = cmd.execute();
+  }
+  else if (fs == "vfat")
+  {
+    CreateFat32 cmd{part_dev, dev_class, discarded};
+    res = cmd.execute();
+  }
+
+  if (res != CmdSuccess)
+  {
+    qCritical() << "Failed to create filesystem: " << strerror(res);
+    return false;
+  }
+  else
+    return true;
+}
+
+
+// mounting
+bool Install::mount()
+{
+  bool mounted_root{false}, mounted_efi{false}, mounted_home{true};
+
+  const auto& mount_data = m_mounts;
+  const fs::path root_mnt = m_target.root, efi_mnt = m_target.efi(), home_mnt = m_target.home();
+
+  if (mount_data.root.dev.empty() || mount_data.efi.dev.empty())
+    log_critical("Could not get partition paths and filesystems");
+  else
+  {
+    // TODO this only checks if path is mounted (i.e. /mnt/boot), should it also 
+    //      check if device is mounted (i.e. /dev/sda2)? If the device is mounted
+    //      elsewhere, we should fail.
+
+    if (PartitionUtils::is_path_mounted(efi_mnt.string()))
+    {
+      log_info(std::format("{} is already mounted, unmounting", efi_mnt.c_str()));
+      ::umount(efi_mnt.c_str());
+    }
+
+    if (PartitionUtils::is_path_mounted(root_mnt.string()))
+    {
+      log_info(std::format("{} is already mounted, unmounting", root_mnt.c_str()));
+      ::umount(root_mnt.c_str());
+    }
+
+    if (PartitionUtils::is_path_mounted(home_mnt.string()))
+    {
+      log_info(std::format("{} is already mounted, unmounting", home_mnt.c_str()));
+      ::umount(home_mnt.c_str());
+    }
+
+    const bool is_root_btr = mount_data.root.fs == "btrfs";
+    const bool is_home_btr = mount_data.home.fs == "btrfs";
+
+    // a VM's disk is likely thin provisioned: discard returns deleted space to the host
+    const bool thin = VmPlan::get().is_vm();
+
+    // options are retained in fstab
+    auto btrfs_opts = [&mount_data, thin](const std::string& dev, const std::string_view subvol)
+    {
+      return mount_data.btrfs.options(subvol,
+                                      PartitionUtils::get_partition_device_class(dev),
+                                      PartitionUtils::get_partition_can_discard(dev),
+                                      thin);
+    };
+
+    auto ext4_opts = [thin](const std::string& dev)
+    {
+      return thin && PartitionUtils::get_partition_can_discard(dev) ? std::string{"discard"} : std::string{};
+    };
+
+    const std::string root_opts = is_root_btr ? btrfs_opts(mount_data.root.dev, "@") : ext4_opts(mount_data.root.dev);
+    const std::string home_opts = is_home_btr ? btrfs_opts(mount_data.home.dev, "@home") : ext4_opts(mount_data.home.dev);
+
+    if (is_root_btr || is_home_btr)
+      log_info(std::format("btrfs profile: {}", mount_data.btrfs.summary()));
+
+    // with the session's options, which fstab doesn't have
+    auto session_mount = [this](const MountData::Mount& part, const fs::path& path, const std::string_view installed, const std::string& opts)
+    {
+      m_session_options[std::string{installed}] = InstallSession::session_options(part.fs, opts);
+      return do_mount(part.dev, path.c_str(), part.fs, InstallSession::mount_options(part.fs, opts), InstallSession::MountFlags);
+    };
+
+    mounted_root = session_mount(mount_data.root, root_mnt, "/", root_opts);
+    mounted_efi = session_mount(mount_data.efi, efi_mnt, "/efi", {});
+
+    log_info(std::format("Mount of {} -> {} : {}", root_mnt.c_str(), mount_data.root.dev, mounted_root ? "Success" : "Fail"));
+    log_info(std::format("Mount of {} -> {} : {}", efi_mnt.c_str(), mount_data.efi.dev, mounted_efi ? "Success" : "Fail"));
+
+    // if btrfs, we still want to mount home, even if it's on the same partition as root, because it's a subvolume
+    if (mount_data.root.fs == "btrfs" || mount_data.home.dev != mount_data.root.dev)
+    {
+      mounted_home = session_mount(mount_data.home, home_mnt, "/home", home_opts);
+      log_info(std::format("Mount of {} -> {} : {}", home_mnt.c_str(), mount_data.home.dev, mounted_home ? "Success" : "Fail"));
+    }
+  }
+
+  return mounted_root && mounted_efi && mounted_home;
+}
+
+
+bool Install::do_mount(const std::string_view dev, const std::string_view path, const std::string_view fs, const std::string_view options,
+                       const unsigned long flags)
+{
+  if (!fs::exists(path))
+    fs::create_directories(path);
+
+  // noatime is a VFS flag rather than a filesystem option, and btrfs rejects it in the data.
+  // It's still in the mount table, so fstab keeps it
+  std::string data;
+  unsigned long mount_flags {flags};
+
+  std::istringstream stream{std::string{options}};
+  for (std::string option; std::getline(stream, option, ','); )
+  {
+    if (option == "noatime")
+      mount_flags |= MS_NOATIME;
+    else if (!option.empty())
+      data.append(data.empty() ? "" : ",").append(option);
+  }
+
+  const int r = ::mount(dev.data(), path.data(), fs.data(), mount_flags, data.c_str()) ;
+  
+  if (r != 0)
+    log_critical(std::format("do_mount(): {} {}", path, ::strerror(errno)));
+  else if (!options.empty())
+    log_info(std::format("Mounted {} with {}", path, options));
+
+  qDebug() << "Leaving";
+
+  return r == 0;    
+}
+
+
+// journal
+static std::string_view mode_name(const InstallMode mode)
+{
+  switch (mode)
+  {
+    using enum InstallMode;
+
+    case Full:    return "full";
+    case Capture: return "capture";
+    case Deploy:  return "deploy";
+    case Resume:  return "resume";
+  }
+  return "";
+}
+
+
+// The partition UUIDs change when a filesystem is created, so they identify the
+// filesystems the journal was written for, rather than the device names.
+StageJournal::Inputs Install::journal_inputs() const
+{
+  StageJournal::Inputs inputs
+  {
+    {"mode", std::string{mode_name(m_mode)}},
+    {"image_dir", m_image_dir.string()},
+    {"root_received", m_root_received ? "1" : "0"}
+  };
+
+  for (const auto& [name, mount] : {std::pair{"root", m_mounts.root}, {"efi", m_mounts.efi}, {"home", m_mounts.home}})
+  {
+    inputs[std::format("{}.dev", name)] = mount.dev;
+    inputs[std::format("{}.fs", name)] = mount.fs;
+    inputs[std::format("{}.uuid", name)] = PartitionUtils::get_partition_uuid(mount.dev);
+  }
+
+  return inputs;
+}
+
+
+void Install::begin_journal()
+{
+  if (!m_journal.begin(m_target.root, journal_inputs()))
+    log_warning("Failed to create the install journal, the install can't be resumed");
+}
+
+
+// What each stage used from the UI. Passwords aren't included, a changed password
+// doesn't repeat the accounts stages.
+std::string Install::stage_inputs(const std::string_view stage) const
+{
+  std::stringstream inputs;
+
+  if (stage == "deploy image" || stage == "capture image")
+    inputs << m_image_dir.string();
+  else if (stage == "network")
+  {
+    const auto data = Widgets::network()->get_data();
+    inputs << data.hostname << ' ' << data.ntp << ' ' << data.copy_config;
+  }
+  else if (stage == "user account" || stage == "shell")
+    inputs << Widgets::accounts()->user_username();
+  else if (stage == "profile")
+  {
+    const auto [profile_name, greeter_name] = Widgets::profile()->get_data();
+    inputs << profile_name.toStdString() << ' ' << greeter_name.toStdString();
+  }
+  else if (stage == "locale")
+  {
+    const auto data = Widgets::start()->get_data();
+    inputs << data.keymap << ' ' << data.locales.join(',').toStdString() << ' ' << data.timezone;
+  }
+
+  inputs << ' ' << stage_packages(stage);
+
+  return inputs.str();
+}
+
+
+PackageSet Install::stage_packages(const std::string_view stage) const
+{
+  if (stage == "pacstrap")
+    return Packages::get({PackageCategory::Required, PackageCategory::Kernel, PackageCategory::Firmware, PackageCategory::Important});
+  else if (stage == "swap" && Widgets::swap()->get_data().zram_enabled)
+    return Packages::make_set({ZramPackage});
+  else if (stage == "bootloader")
+    return Packages::make_set(BootPackages);
+  else if (stage == "shell")
+    return Packages::shells();
+  else if (stage == "profile")
+    return Packages::get({PackageCategory::Profile, PackageCategory::Greeter});
+  else if (stage == "packages")
+    return Packages::additional();
+  else if (stage == "video")
+    return Packages::video();
+  else
+    return {};
+}
+
+
+// uses the target's package database, without the chroot
+bool Install::packages_installed(const PackageSet& packages)
+{
+  if (packages.empty())
+    return true;
+
+  std::stringstream cmd_string;
+  cmd_string << "pacman -Q --dbpath " << m_target.path("var/lib/pacman").string() << ' ' << packages;
+
+  Command cmd{cmd_string.str(), [this](const std::string_view out)
+  {
+    if (out.starts_with("error:"))
+      log_info(out);
+  }};
+
+  return cmd.execute() == CmdSuccess;
+}
+
+
+// Continue from the first incomplete stage. The journal must be for the mounted
+// partitions. A completed stage is repeated, with those after it, if its inputs have
+// changed or its packages aren't installed (i.e. lost in a power cut).
+bool Install::resume_journal()
+{
+  if (!m_journal.load(m_target.root))
+  {
+    log_critical(std::format("No install journal on {}, can't resume", m_mounts.root.dev));
+    return false;
+  }
+
+  const auto current = journal_inputs();
+
+  for (const auto& [key, value] : current)
+  {
+    if ((key.ends_with(".uuid") || key.ends_with(".fs")) && m_journal.input(key) != value)
+    {
+      log_critical(std::format("The journal is for different partitions ({} was {}, is {}), can't resume", key, m_journal.input(key), value));
+      m_journal.close();
+      return false;
+    }
+  }
+
+  if (const auto mode = m_journal.input("mode"); mode == mode_name(InstallMode::Full))
+    m_mode = InstallMode::Full;
+  else if (mode == mode_name(InstallMode::Capture))
+    m_mode = InstallMode::Capture;
+  else if (mode == mode_name(InstallMode::Deploy))
+    m_mode = InstallMode::Deploy;
+  else
+  {
+    log_critical(std::format("Invalid mode in the journal: {}", mode));
+    m_journal.close();
+    return false;
+  }
+
+  m_image_dir = m_journal.input("image_dir");
+  m_root_received = m_journal.input("root_received") == "1";
+
+  // copy, invalidate() removes stages
+  const auto stages = m_journal.stages();
+
+  for (const auto& stage : stages)
+  {
+    std::string_view reason;
+
+    if (StageJournal::digest(stage_inputs(stage.name)) != stage.digest)
+      reason = "inputs have changed";
+    else if (!packages_installed(stage_packages(stage.name)))
+      reason = "packages are missing";
+
+    if (!reason.empty())
+    {
+      log_info(std::format("Stage {} is repeated, its {}", stage.name, reason));
+      m_journal.invalidate(stage.name);
+      break;
+    }
+  }
+
+  if (m_journal.stages().empty())
+    log_info(std::format("Resuming {} install from the start", m_journal.input("mode")));
+  else
+    log_info(std::format("Resuming {} install after stage {}", m_journal.input("mode"), m_journal.stages().back().name));
+
+  return true;
+}
+
+
+// The install thread was stopped, commands were terminated. Nothing is left mounted in
+// the target, including what arch-chroot mounted if it was killed before its cleanup.
+// The journal is kept, so the install can be resumed.
+void Install::cancelled()
+{
+  log_critical("Install cancelled");
+
+  // pacman was killed, so its lock would prevent a resume
+  std::error_code ec;
+  fs::remove(m_target.path("var/lib/pacman/db.lck"), ec);
+
+  // mounts in mount order: only those after the target root was mounted are in the target
+  std::vector<std::string> mounts;
+
+  if (std::ifstream stream{"/proc/self/mounts"}; stream.good())
+  {
+    const std::string root = m_target.root.string();
+
+    for (std::string line; std::getline(stream, line); )
+    {
+      std::istringstream fields{line};
+      std::string dev, path;
+      fields >> dev >> path;
+
+      if (path == root)
+        mounts.clear();
+
+      if (path == root || path.starts_with(root + '/'))
+        mounts.push_back(path);
+    }
+  }
+
+  // deepest first
+  std::stable_sort(mounts.begin(), mounts.end(), [](const std::string& a, const std::string& b){ return a.size() > b.size(); });
+
+  for (const auto& path : mounts)
+  {
+    if (::umount(path.c_str()) == 0 || ::umount2(path.c_str(), MNT_DETACH) == 0)
+      log_info(std::format("Unmounted {}", path));
+    else
+      log_warning(std::format("Failed to unmount {}: {}", path, ::strerror(errno)));
+  }
+}
+
+
+// a stage's changes to the target's filesystems survive a power cut
+bool Install::sync_target()
+{
+  bool ok = true;
+
+  for (const auto& path : {m_target.root, m_target.efi(), m_target.home()})
+  {
+    // syncfs() reports writeback errors since the file was opened, so opened before the sync
+    if (const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); fd < 0)
+      ok = false;
+    else
+    {
+      if (::syncfs(fd) != 0)
+      {
+        log_warning(std::format("Failed to sync {}: {}", path.string(), ::strerror(errno)));
+        ok = false;
+      }
+      ::close(fd);
+    }
+  }
+
+  return ok;
+}
+
+
+// Barriers are restored, so the sync flushes the disk's cache, then the files required
+// to boot are checked
+bool Install::end_session()
+{
+  const auto& mount_data = m_mounts;
+
+  InstallSession::end_mount(mount_data.root.dev, m_target.root, mount_data.root.fs);
+
+  if (mount_data.root.fs == "btrfs" || mount_data.home.dev != mount_data.root.dev)
+    InstallSession::end_mount(mount_data.home.dev, m_target.home(), mount_data.home.fs);
+
+  if (!sync_target())
+  {
+    log_critical("Failed to sync the target filesystems");
+    return false;
+  }
+
+  return verify_boot();
+}
+
+
+bool Install::verify_boot()
+{
+  std::vector<fs::path> files {m_target.path("boot/grub/grub.cfg")};
+
+  // the kernel and initramfs per kernel package
+  std::error_code ec;
+  for (const auto& dir : fs::directory_iterator{m_target.path("usr/lib/modules"), ec})
+  {
+    if (std::string pkgbase; std::ifstream{dir.path() / "pkgbase"} >> pkgbase)
+    {
+      files.emplace_back(m_target.path(std::format("boot/vmlinuz-{}", pkgbase)));
+      files.emplace_back(m_target.path(std::format("boot/initramfs-{}.img", pkgbase)));
+    }
+  }
+
+  bool ok = files.size() > 1;
+
+  if (!ok)
+    log_critical("No kernels installed");
+
+  for (const auto& file : files)
+  {
+    if (!fs::exists(file, ec) || fs::file_size(file, ec) == 0)
+    {
+      log_critical(std::format("{} is missing or empty", file.string()));
+      ok = false;
+    }
+  }
+
+  if (ok)
+    log_info(std::format("Synced, verified {} boot files", files.size()));
+
+  return ok;
+}
+
+
+// images
+bool Install::capture_image()
+{
+  SystemImage image{[this](const std::string_view msg){ log_info(msg); }, [this](const std::string_view msg){ log_warning(msg); }};
+
+  const auto& mount_data = m_mounts;
+  
+  bool ok{false};
+
+  if (mount_data.root.fs == "btrfs")
+  {
+    // the top level is mounted to snapshot and send @
+    const fs::path top_level = format_mount_path(mount_data.root.dev);
+
+    if (std::error_code ec; !fs::create_directories(top_level, ec) && ec)
+      log_critical(std::format("Failed to create {}: {}", top_level.string(), ec.message()));
+    else if (do_mount(mount_data.root.dev, top_level.string(), "btrfs", "subvolid=5"))
+    {
+      ok = image.capture(m_target.root, m_image_dir, top_level, "@");
+      ::umount(top_level.c_str());
+    }
+  }
+  else
+    ok = image.capture(m_target.root, m_image_dir);
+  
+  if (!ok)
+    log_critical(std::format("Failed to capture image to {}", m_image_dir.string()));
+  else
+    log_info(std::format("Captured image to {}", m_image_dir.string()));
+
+  return ok;
+}
+
+
+bool Install::deploy_image()
+{
+  SystemImage image{[this](const std::string_view msg){ log_info(msg); }, [this](const std::string_view msg){ log_warning(msg); }};
+
+  if (!image.deploy(m_image_dir, m_target.root, m_root_received))
+  {
+    log_critical(std::format("Failed to deploy image from {}", m_image_dir.string()));
+    return false;
+  }
+
+  // the image's initramfs was created by autodetect on the reference machine
+  log_info("Creating initramfs");
+
+  vm_initramfs();
+  initramfs_compression();
+
+  ChRootCmd mkinitcpio{m_target.root, "mkinitcpio -P", [this](const std::string_view out)
+  {
+    log_info(out);
+  }};
+
+  if (mkinitcpio.execute() != CmdSuccess)
+    log_warning("mkinitcpio failed, the fallback initramfs may still boot");
+
+  configure_pacman(m_target.path(PacmanConf::TargetPath));
+
+  return true;
+}
+
+
+// pacstrap
+/// This only installs required, kernels, firmware and important,
+/// i.e. packages that are required/important to a useful bootable Arch
+bool Install::pacman_strap()
+{
+  auto create_cmd_string = [this]()
+  {
+    // pacstrap -K <root_mount> <package_list>
+
+    std::stringstream cmd_string;
+    cmd_string << "pacstrap -K " << m_target.root.string() << ' ';
+
+    // after the root, pacstrap passes everything to pacman
+    if (m_hooks_deferred)
+      cmd_string << PacmanHooks::hookdir_option(m_target.root) << ' ';
+
+    cmd_string << Packages::get({PackageCategory::Required, PackageCategory::Kernel, PackageCategory::Firmware, PackageCategory::Important});
+
+    return cmd_string.str();
+  };
+
+  
+  // concurrent installs have done this once, before waiting for each other
+  if (!m_shared)
+    prepare_live();
+
+  // before the kernel is installed, so the initramfs is created once
+  vm_initramfs();
+
+  const auto cmd_string = create_cmd_string();
+
+  log_info(cmd_string);
+  
+  // intercept missing firmware message from pacstrap
+  Command pacstrap {cmd_string, [this](const std::string_view out)
+  {    
+    if (out.find("Possibly missing firmware for module:") != std::string::npos)
+      log_warning("Possibly missing firmware. This can be fixed post-install");
+    else
+      log_info(out);
+  }};
+
+  pacstrap.set_limits(std::chrono::seconds{0}, PacmanStallLimit);
+  
+  bool ok = true;
+  if (pacstrap.execute() != CmdSuccess)
+  {
+    log_critical("ERROR: pacstrap failed - manual intervention required");
+    ok = false;
+  }
+  else
   {
-    log_critical("Install encountered an unknown exception");
+    // ranking may have finished during pacstrap, which still benefits later installs in the chroot
+    apply_mirrors(m_target.path(Mirrors::TargetMirrorList));
+    configure_pacman(m_target.path(PacmanConf::TargetPath));
+    build_config();
+
+    if (m_mounts.root.fs == "btrfs")
+      log_btrfs_usage(m_mounts.btrfs);
   }
+
+  return ok;
 }
 
 
-// filesystems
-bool Install::filesystems()
+// The paravirtual storage drivers, autodetect only includes the current disk controller's
+void Install::vm_initramfs()
 {
-  // TODO after adding btrfs, this function has become a slight mess
+  const auto& modules = VmPlan::get().initramfs_modules;
 
-  const auto [valid, mounts] = Widgets::partitions()->get_data();
-
-  // sanity: UI should prevent this
-  if (!valid)
-  {
-    log_critical("Mounts are invalid");
-    return false;
-  }
+  if (modules.isEmpty())
+    return;
 
-  const bool create_home_partition = mounts.home.create_fs && mounts.home.dev != mounts.root.dev;
+  const fs::path conf {m_target.path("etc/mkinitcpio.conf.d/ali-vm.conf")};
 
-  bool root{false}, efi{true}, home{true};
+  std::error_code ec;
+  fs::create_directories(conf.parent_path(), ec);
 
-  // wipefs, set partition type, create new fs for root, boot and home if applicable
-  if (mounts.root.create_fs)
-  {
-    if (!wipe_fs(mounts.root.dev))
-      return false;
+  if (!FileUtils::write_atomic(conf, std::format("MODULES+=({})\n", modules.join(' ').toStdString())))
+    log_warning(std::format("Failed to write {}, the initramfs only has the current disk controller's driver", conf.string()));
+  else
+    log_info(std::format("Initramfs modules for {}: {}", VmPlan::get().name(), modules.join(' ').toStdString()));
+}
 
-    if (mounts.root.fs == "btrfs")
-      root = create_btrfs_filesystem(mounts.root.dev, RootMnt, MountType::Root);
-    else if (root)
-      root = create_filesystem(mounts.root.dev, mounts.root.fs);
 
-    if (root)
-    {
-      log_info("Setting root partition type");
-      set_partition_type<SetPartitionAsLinuxRoot>(mounts.root.dev);
-    }
-  }
-  
-  if (mounts.efi.create_fs)
-  {
-    efi = wipe_fs(mounts.efi.dev) && create_filesystem(mounts.efi.dev, mounts.efi.fs);
-    if (efi)
-    {
-      log_info("Setting efi partition type");
-      set_partition_type<SetPartitionAsEfi>(mounts.efi.dev);
-    }
-  }
-  
-  if (create_home_partition)
-  {
-    if (!wipe_fs(mounts.home.dev))
-      return false;
-    
-    if (mounts.home.fs == "btrfs")
-      home = create_btrfs_filesystem(mounts.home.dev, HomeMnt, MountType::Home);
-    else if (home)
-      home = create_filesystem(mounts.home.dev, mounts.home.fs);
+// initramfs per kernel are created concurrently, but zstd is single threaded by default
+void Install::initramfs_compression()
+{
+  const fs::path conf {m_target.path("etc/mkinitcpio.conf.d/ali-compression.conf")};
 
-    if (home)
-    {
-      log_info("Setting home partition type");
-      set_partition_type<SetPartitionAsLinuxHome>(mounts.home.dev);  
-    }
-  }
-  else
-  {
-    // create subvol for @home, which is mounted to root
-    home = create_btrfs_subvolume(mounts.root.dev, RootMnt, "@home");
-  }
+  std::error_code ec;
+  fs::create_directories(conf.parent_path(), ec);
 
-  return root && efi && home;
+  if (!FileUtils::write_atomic(conf, "COMPRESSION=\"zstd\"\nCOMPRESSION_OPTIONS=(-T0)\n"))
+    log_warning(std::format("Failed to write {}, the initramfs compression is the default", conf.string()));
 }
 
 
-bool Install::wipe_fs(const std::string_view dev)
+void Install::defer_hooks()
 {
-  log_info(std::format("Wiping filesystem on {}", dev));
-  Command wipe {std::format ("wipefs -a -f {}", dev)};
-  return wipe.execute() == CmdSuccess;
+  // a deployed image has its packages, and creates the initramfs itself
+  if (m_mode == InstallMode::Deploy)
+    return;
+
+  initramfs_compression();
+
+  if (m_hooks_deferred = PacmanHooks::defer(m_target.root); m_hooks_deferred)
+    log_info("Deferring initramfs, DKMS and cache hooks until all packages are installed");
+  else
+    log_warning("Failed to defer pacman hooks, they run for each install");
 }
 
 
-bool Install::create_btrfs_filesystem(const std::string_view part_dev, const fs::path mount, const MountType type)
+// the deferred hooks, once. The kernels are only now in /boot, so grub.cfg is created after
+bool Install::pacman_hooks()
 {
-  // for btrfs, we make btrfs, mount it without options, create subvolume, then unmount.
-  // the mount step following this function will mount with appropriate btrfs options
-  // so that fstab is created correctly
-
-  bool ok{false};
+  const auto groups = PacmanHooks::groups(m_target.root);
 
-  log_info(std::format("Creating btrfs on {}", part_dev));
+  bool ok = true;
 
-  if (type == MountType::Esp)
-    log_critical("Invalid mount type for BTRFS volume. Must be home or root");
-  else
+  if (!groups.empty())
   {
-    if (CreateBtrFs cmd{part_dev}; cmd.execute() == CmdSuccess)
-      ok = create_btrfs_subvolume(part_dev, mount, type == MountType::Root ? "@" : "@home");
+    log_info(std::format("Running {} deferred hooks", groups.size()));
+
+    CommandGroupRunner runner {m_target.root, "",
+                               std::bind_front(&Install::log_info, this),
+                               std::bind_front(&Install::log_warning, this)};
+
+    ok = runner.run(groups);
+
+    // DKMS and caches can be fixed after, but not booting without an initramfs
+    for (const auto& result : runner.results())
+    {
+      if (result.exit_code != 0 && result.group.starts_with(PacmanHooks::InitramfsGroup))
+      {
+        log_critical(std::format("Failed to create {}", result.group));
+        ok = false;
+      }
+    }
   }
 
-  return ok;
+  // before capture, the image must not have them
+  PacmanHooks::restore(m_target.root);
+
+  return ok && grub_config();
 }
 
 
-bool Install::create_btrfs_subvolume(const std::string_view part_dev, const fs::path mount, const std::string_view subvolume)
+// makepkg defaults to a single make job and single threaded compression, and DKMS's jobs
+// are set rather than relying on its default. Both configs are sourced as shell when they
+// run, so an image deployed elsewhere uses that machine's cores
+void Install::build_config()
 {
-  log_info(std::format("Creating subvolume {} on {}", subvolume, mount.string()));
+  const bool ccache = Packages::have_package("ccache");
 
-  bool ok {false};
+  std::stringstream makepkg;
+  makepkg << "MAKEFLAGS=\"-j$(nproc)\"\n";
+  makepkg << "COMPRESSZST=(zstd -c -T0 -)\n";
+
+  if (ccache)
+    makepkg << "BUILDENV=(!distcc color ccache check !sign)\n";
 
-  if (do_mount(part_dev, mount.string(), "btrfs", no_fs_opts{}))
+  const std::vector<std::pair<fs::path, std::string>> confs
   {
-    CreateBtrVolume cmd_volume{mount, subvolume};
-    ok =  cmd_volume.execute() == CmdSuccess &&
-          ::umount(mount.string().data()) == 0;
+    {m_target.path("etc/makepkg.conf.d/ali.conf"),          makepkg.str()},
+    {m_target.path("etc/dkms/framework.conf.d/ali.conf"),   "parallel_jobs=$(nproc)\n"}
+  };
+
+  for (const auto& [conf, content] : confs)
+  {
+    std::error_code ec;
+    fs::create_directories(conf.parent_path(), ec);
+
+    if (!FileUtils::write_atomic(conf, content))
+      log_warning(std::format("Failed to write {}, builds use the defaults", conf.string()));
   }
 
-  return ok;
+  log_info(std::format("Builds use all cores{}", ccache ? ", makepkg uses ccache" : ""));
 }
 
 
-bool Install::create_filesystem(const std::string_view part_dev, const std::string_view fs)
+// guest agents, which the Packages page selects
+bool Install::virtual_machine()
 {
-  log_info(std::format("Creating {} on {}", fs, part_dev));
+  const auto& vm = VmPlan::get();
 
-  int res {CmdFail};
-  
-  if (fs == "ext4")
-  {
-    CreateExt4 cmd{part_dev};
-    res = cmd.execute();
-  }
-  else if (fs == "vfat")
+  log_info(std::format("Virtual machine: {}", vm.name()));
+
+  // a deployed image may be from bare metal
+  if (m_mode == InstallMode::Deploy && !vm.guest_packages.isEmpty())
+    pacman_install(vm.guest_packages);
+  else if (std::none_of(vm.guest_packages.cbegin(), vm.guest_packages.cend(), [](const QString& name){ return Packages::have_package(name.toStdString()); }))
   {
-    CreateFat32 cmd{part_dev};
-    res = cmd.execute();
+    log_info("No guest agent selected");
+    return true;
   }
 
-  if (res != CmdSuccess)
+  for (const auto& service : vm.guest_services)
   {
-    qCritical() << "Failed to create filesystem: " << strerror(res);
-    return false;
+    if (!enable_service(service))
+      log_warning(std::format("Failed to enable {}", service));
   }
-  else
-    return true;
+
+  // not a reason to fail
+  return true;
 }
 
 
-// mounting
-bool Install::mount()
+// pacstrap copies the live mirrorlist to the target, but not pacman.conf
+void Install::prepare_live()
 {
-  bool mounted_root{false}, mounted_efi{false}, mounted_home{true};
+  apply_mirrors(Mirrors::LiveMirrorList);
+  configure_pacman(PacmanConf::LivePath);
+}
 
-  const auto [valid, mount_data] = Widgets::partitions()->get_data();
 
-  if (!valid)
-    log_critical("Could not get partition paths and filesystems");
-  else
-  {
-    // TODO this only checks if path is mounted (i.e. /mnt/boot), should it also 
-    //      check if device is mounted (i.e. /dev/sda2)? If the device is mounted
-    //      elsewhere, we should fail.
+// all packages, downloaded once for concurrent installs
+static std::vector<std::string> package_plan()
+{
+  auto names = Packages::all_names();
 
-    if (PartitionUtils::is_path_mounted(EfiMnt.string()))
-    {
-      log_info(std::format("{} is already mounted, unmounting", EfiMnt.c_str()));
-      ::umount(EfiMnt.c_str());
-    }
+  for (const auto& name : BootPackages)
+    names.push_back(name.toStdString());
 
-    if (PartitionUtils::is_path_mounted(RootMnt.string()))
-    {
-      log_info(std::format("{} is already mounted, unmounting", RootMnt.c_str()));
-      ::umount(RootMnt.c_str());
-    }
+  if (Widgets::swap()->get_data().zram_enabled)
+    names.push_back(ZramPackage.toStdString());
 
-    if (PartitionUtils::is_path_mounted(HomeMnt.string()))
-    {
-      log_info(std::format("{} is already mounted, unmounting", HomeMnt.c_str()));
-      ::umount(HomeMnt.c_str());
-    }
+  return names;
+}
 
-    const bool is_root_btr = mount_data.root.fs == "btrfs";
-    const bool is_home_btr = mount_data.home.fs == "btrfs";
 
-    mounted_root = do_mount(mount_data.root.dev, RootMnt.c_str(), mount_data.root.fs, is_root_btr ? "subvol=@" : no_fs_opts{});
-    mounted_efi = do_mount(mount_data.efi.dev, EfiMnt.c_str(), mount_data.efi.fs);
+void Install::share_cache(const bool mounted)
+{
+  m_shared_arrived = true;
 
-    log_info(std::format("Mount of {} -> {} : {}", RootMnt.c_str(), mount_data.root.dev, mounted_root ? "Success" : "Fail"));
-    log_info(std::format("Mount of {} -> {} : {}", EfiMnt.c_str(), mount_data.efi.dev, mounted_efi ? "Success" : "Fail"));
+  log_info("Waiting for other targets");
 
-    // if btrfs, we still want to mount home, even if it's on the same partition as root, because it's a subvolume
-    if (mount_data.root.fs == "btrfs" || mount_data.home.dev != mount_data.root.dev)
+  const fs::path cache = m_shared->arrive(m_target, mounted, [this](const fs::path& cache)
+  {
+    // run once for all targets, by the thread of the last to arrive
+    prepare_live();
+
+    // a deployed image has the packages
+    if (m_mode == InstallMode::Deploy)
+      return true;
+
+    log_info(std::format("Downloading packages for all targets to {}", cache.string()));
+
+    return SharedInstall::download(package_plan(), cache, [this](const std::string_view out){ log_info(out); });
+  });
+
+  if (!mounted)
+    return;
+  else if (cache.empty())
+    log_warning("No shared package cache, each target downloads packages");
+  else if (const fs::path own_cache = m_target.path(SharedInstall::CachePath); cache != own_cache)
+  {
+    std::error_code ec;
+    fs::create_directories(own_cache, ec);
+
+    // not in fstab, see fstab()
+    if (::mount(cache.c_str(), own_cache.c_str(), nullptr, MS_BIND, nullptr) != 0)
+      log_warning(std::format("Failed to bind mount the shared package cache: {}", ::strerror(errno)));
+    else
     {
-      mounted_home = do_mount(mount_data.home.dev, HomeMnt.c_str(), mount_data.home.fs, is_home_btr ? "subvol=@home" : no_fs_opts{});
-      log_info(std::format("Mount of {} -> {} : {}", HomeMnt.c_str(), mount_data.home.dev, mounted_home ? "Success" : "Fail"));
+      m_cache_bind = own_cache;
+      log_info(std::format("Using shared package cache {}", cache.string()));
     }
   }
+}
 
-  return mounted_root && mounted_efi && mounted_home;
+
+void Install::apply_mirrors(const fs::path& mirrorlist)
+{
+  // ranking runs in the background from startup, if it's not finished, don't wait
+  if (const auto mirrors = Mirrors::ranked(); !mirrors)
+    log_info("Mirror ranking not complete, using existing mirrorlist");
+  else if (!Mirrors::write(mirrorlist, *mirrors))
+    log_warning(std::format("Failed to write ranked mirrors to {}", mirrorlist.string()));
+  else
+    log_info(std::format("Wrote {} ranked mirrors to {}, fastest: {}", mirrors->size(), mirrorlist.string(), mirrors->front().server));
 }
 
 
-bool Install::do_mount(const std::string_view dev, const std::string_view path, const std::string_view fs, const std::string_view options)
+void Install::configure_pacman(const fs::path& conf)
 {
-  if (!fs::exists(path))
-    fs::create_directory(path);
+  // fastest ranked mirror is the best measure, otherwise the startup measurement
+  std::optional<uint64_t> speed;
 
-  const int r = ::mount(dev.data(), path.data(), fs.data(), 0, options.data()) ;
-  
-  if (r != 0)
-    log_critical(std::format("do_mount(): {} {}", path, ::strerror(errno)));
+  if (const auto mirrors = Mirrors::ranked(); mirrors)
+    speed = mirrors->front().speed;
+  else
+    speed = PackageEstimator::download_speed();
 
-  qDebug() << "Leaving";
+  const auto settings = PacmanSettings::from_speed(speed);
 
-  return r == 0;    
+  if (PacmanConf::apply(conf, settings))
+    log_info(std::format("pacman config {}: {} (download speed: {}/s)", conf.string(), settings.summary(), speed ? format_size(*speed) : "unknown"));
+  else
+    log_warning(std::format("Failed to configure {}, using existing settings", conf.string()));
 }
 
 
-// pacstrap
-/// This only installs required, kernels, firmware and important,
-/// i.e. packages that are required/important to a useful bootable Arch
-bool Install::pacman_strap()
+// Show the effect of the btrfs compression: the apparent size of the files
+// written by pacstrap compared with the space used on the filesystem. 
+// Only files on the root subvolume are counted (not /home or /efi).
+void Install::log_btrfs_usage(const BtrfsMountProfile& profile)
 {
-  auto create_cmd_string = []()
-  {
-    // pacstrap -K <root_mount> <package_list>
-
-    std::stringstream cmd_string;
-    cmd_string << "pacstrap -K " << RootMnt.string() << ' ';
-    cmd_string << Packages::required();
-    cmd_string << Packages::kernels();
-    cmd_string << Packages::firmware();
-    cmd_string << Packages::important();
-
-    return cmd_string.str();
-  };
+  struct stat root_stat;
+  struct statvfs root_vfs;
 
+  if (::lstat(m_target.root.c_str(), &root_stat) != 0 || ::statvfs(m_target.root.c_str(), &root_vfs) != 0)
+    return;
   
-  const auto cmd_string = create_cmd_string();
+  uint64_t apparent{0};
+  std::error_code ec;
 
-  log_info(cmd_string);
-  
-  // intercept missing firmware message from pacstrap
-  Command pacstrap {cmd_string, [this](const std::string_view out)
-  {    
-    if (out.find("Possibly missing firmware for module:") != std::string::npos)
-      log_warning("Possibly missing firmware. This can be fixed post-install");
-    else
-      log_info(out);
-  }};
-  
-  bool ok = true;
-  if (pacstrap.execute() != CmdSuccess)
+  for (auto it = fs::recursive_directory_iterator{m_target.root, fs::directory_options::skip_permission_denied, ec};
+       it != fs::recursive_directory_iterator{} ;
+       it.increment(ec))
   {
-    log_critical("ERROR: pacstrap failed - manual intervention required");
-    ok = false;
+    struct stat st;
+    if (::lstat(it->path().c_str(), &st) != 0)
+      continue;
+
+    // different st_dev: another subvolume or filesystem
+    if (st.st_dev != root_stat.st_dev)
+    {
+      if (S_ISDIR(st.st_mode))
+        it.disable_recursion_pending();
+    }
+    else if (S_ISREG(st.st_mode))
+      apparent += st.st_size;
   }
 
-  return ok;
+  const uint64_t used = (root_vfs.f_blocks - root_vfs.f_bfree) * root_vfs.f_frsize;
+
+  if (used && apparent)
+  {
+    static const double MiB = 1024.0 * 1024.0;
+
+    log_info(std::format("btrfs ({}): {:.1f} MiB of files use {:.1f} MiB on disk, ratio {:.2f}",
+                          profile.summary(), apparent / MiB, used / MiB, static_cast<double>(apparent) / used));
+  }
 }
 
 
@@ -374,15 +1364,15 @@ bool Install::swap()
   {
     log_info("Installing zram generator");
     
-    if (pacman_install({"zram-generator"}))
+    if (pacman_install({ZramPackage}))
     {
-      static const fs::path ZramConfig {RootMnt / "etc/systemd/zram-generator.conf"};
+      const fs::path ZramConfig {m_target.path("etc/systemd/zram-generator.conf")};
 
       {
         // write the config, keep it simple for now, with values suggested in wiki
         std::ofstream cfg_file{ZramConfig, std::ios_base::out | std::ios_base::trunc};
         cfg_file << "[zram0]\n";
-        cfg_file << "zram-size = min(ram / 2, 4096)\n";
+        cfg_file << "zram-size = " << VmPlan::get().zram_size << '\n';
         cfg_file << "compression-algorithm = zstd";
       }
           
@@ -408,14 +1398,19 @@ bool Install::swap()
 // fstab
 bool Install::fstab()
 {
-  fs::create_directory((RootMnt / FsTabPath).parent_path());
+  const fs::path fstab_path = m_target.fstab();
 
-  Command fstab {std::format("genfstab -U {} > {}", RootMnt.string(), FsTabPath.string())};
+  // the shared package cache is only mounted during install
+  std::vector<fs::path> exclude;
+  if (!m_cache_bind.empty())
+    exclude.push_back(m_cache_bind);
 
-  const bool ok = fstab.execute() == CmdSuccess && fs::exists(FsTabPath) && fs::file_size(FsTabPath);
+  const bool ok = FsTab::write(m_target.root, fstab_path, exclude, m_session_options) && fs::exists(fstab_path) && fs::file_size(fstab_path);
   
   if (!ok)
     log_critical("fstab failed");
+  else
+    log_info(std::format("Created {}", fstab_path.string()));
   
   return ok;
 }
@@ -427,19 +1422,19 @@ bool Install::localise()
   const auto locale_data = Widgets::start()->get_data();
 
   log_info("Setting timezone");
-  if (!LocaleUtils::generate_timezone(locale_data.timezone))
+  if (!LocaleUtils::generate_timezone(m_target.root, locale_data.timezone))
   {
     log_warning("Setting timezone failed");
   }
   
   log_info("Generating locales");
-  if (!LocaleUtils::generate_locale(locale_data.locales, locale_data.locales[0]))
+  if (!LocaleUtils::generate_locale(m_target.root, locale_data.locales, locale_data.locales[0]))
   {
     log_warning("Generating/setting locales failed");
   }
 
   log_info(std::format("Setting keymap {}", locale_data.keymap));
-  if (!LocaleUtils::generate_keymap(locale_data.keymap, true))
+  if (!LocaleUtils::generate_keymap(m_target.root, locale_data.keymap, true))
   {
     log_warning("Setting key map failed");
   }
@@ -455,7 +1450,7 @@ bool Install::network()
   const auto data = Widgets::network()->get_data();
   
   {
-    std::ofstream host_stream {RootMnt / "etc/hostname", std::ios_base::out | std::ios_base::trunc};
+    std::ofstream host_stream {m_target.path("etc/hostname"), std::ios_base::out | std::ios_base::trunc};
     if (host_stream.good())
       host_stream << data.hostname << '\n';
     else
@@ -466,7 +1461,7 @@ bool Install::network()
   if (data.copy_config)
   {
     static const fs::path sysd_config_src {"/etc/systemd/network"};
-    static const fs::path sysd_config_dest {RootMnt / "etc/systemd/network"};
+    const fs::path sysd_config_dest {m_target.path("etc/systemd/network")};
 
     // some DE uses NetworkManager and others use IWD. 
     // TODO don't handle cases where NetworkManager is configured to use iwd as a backend
@@ -474,7 +1469,7 @@ bool Install::network()
     {
       // iwd config: https://wiki.archlinux.org/title/Iwd#Network_configuration
       static const fs::path iwd_config_src {"/var/lib/iwd"};
-      static const fs::path iwd_config_dest {RootMnt / "var/lib/iwd"};
+      const fs::path iwd_config_dest {m_target.path("var/lib/iwd")};
 
       if (copy_files(iwd_config_src, iwd_config_dest, {".psk", ".open", ".8021x"}))
         enable_service("iwd.service");
@@ -523,6 +1518,20 @@ bool Install::root_account()
 }
 
 
+static bool user_exists(const fs::path& root, const std::string_view user)
+{
+  if (std::ifstream passwd{root / "etc/passwd"}; passwd.good())
+  {
+    for (std::string line; std::getline(passwd, line); )
+    {
+      if (line.starts_with(user) && line.size() > user.size() && line[user.size()] == ':')
+        return true;
+    }
+  }
+  return false;
+}
+
+
 bool Install::user_account()
 {
   const std::string username = Widgets::accounts()->user_username();
@@ -549,13 +1558,19 @@ bool Install::user_account()
     const bool can_sudo = Widgets::accounts()->user_is_sudo();
     const std::string wheel_group = can_sudo ? "-G wheel" : "";
 
-    // use the `useradd` command, without the password, set that after with passwd
+    // use the `useradd` command, without the password, set that after in /etc/shadow
     //  -s shell
     //  -m create home directory
     //  -G wheel (if sudo permitted)
-    ChRootCmd useradd{std::format("useradd -s /usr/bin/bash -m {} {}", wheel_group, username)} ;
+    ChRootCmd useradd{m_target.root, std::format("useradd -s /usr/bin/bash -m {} {}", wheel_group, username)} ;
+
+    // a deployed image may already have the user, then only the password is set
+    const bool exists = m_mode == InstallMode::Deploy && user_exists(m_target.root, username);
 
-    if (const int r = useradd.execute(); r != CmdSuccess)
+    if (exists)
+      log_info(std::format("User {} exists in image", username));
+
+    if (const int r = exists ? CmdSuccess : useradd.execute(); r != CmdSuccess)
     {
       log_info(std::format("User created failed: {}", strerror(r)));
     }
@@ -579,7 +1594,7 @@ bool Install::add_to_sudoers(const std::string& user)
   using namespace std::string_literals;
 
   static const fs::perms SudoersFilePerms = fs::perms::owner_read | fs::perms::group_read;
-  static const fs::path SudoersD = RootMnt / "etc/sudoers.d";
+  const fs::path SudoersD = m_target.path("etc/sudoers.d");
 
   log_info("Adding user to sudoers");
 
@@ -625,29 +1640,14 @@ bool Install::set_password(const std::string_view user, const std::string_view p
 {
   log_info(std::format("Setting password for {}", user));
 
-  bool pass_set{false};
-
-  ChRootCmd cmd_passwd{std::format("echo {}:{} | chpasswd", user, pass), true};
-  if (cmd_passwd.execute() == CmdSuccess)
+  // hashed and written to /etc/shadow, which is then read again to verify
+  if (!Shadow::set_password(m_target.path(Shadow::TargetPath), user, pass))
   {
-    qDebug() << "chpasswd success";
-
-    // we don't launch shell so that the output of `passwd` command is the only output returned
-    ChRootCmd cmd_check{std::format("passwd -S {}", user), [&user, &pass_set](const std::string_view out)
-    {
-      qDebug () << "Password check returns: " << out;
-
-      if (out.size() > user.size()) // at least "<user> P"
-      {
-        if (const auto pos = out.find(' '); pos != std::string_view::npos)
-          pass_set = out.substr(pos+1, 1) == "P";
-      }
-    }};
-
-    cmd_check.execute(); // if this fails, pass_valid remains false
+    log_critical(std::format("Failed to set password for {}", user));
+    return false;
   }
 
-  return pass_set;
+  return true;
 }
 
 
@@ -660,49 +1660,72 @@ bool Install::boot_loader()
   // TODO: systemd-boot
 
   // TODO if btrfs, install grub-btrfs
-  if (!pacman_install({"grub", "efibootmgr", "os-prober"}))
+  if (!pacman_install(BootPackages))
   {
     log_critical("pacman install failed");
   }
   else
   {
-    const std::string install_cmd = std::format("grub-install --target=x86_64-efi --efi-directory=/efi --bootloader-id=GRUB");
+    // the disks of concurrent installs are moved to other machines, so don't add a boot entry to this machine's NVRAM
+    const std::string install_cmd = std::format("grub-install --target=x86_64-efi --efi-directory=/efi --bootloader-id=GRUB{}",
+                                                m_target.is_multi() ? " --removable" : "");
 
     qDebug() << "GRUB install command: " << install_cmd;
     
-    ChRootCmd grub_install{install_cmd, [this](const std::string_view out)
+    ChRootCmd grub_install{m_target.root, install_cmd, [this](const std::string_view out)
     {
       log_info(out);
     }};
 
+    grub_install.set_limits(GrubDeadline);
+
     if (r = grub_install.execute(); r != CmdSuccess)
     {
       log_critical(std::format("grub-install failed: {}", strerror(r)));
     }
+    else if (m_hooks_deferred)
+    {
+      log_info("grub.cfg is created after the deferred hooks install the kernels");
+      ok = true;
+    }
     else
+      ok = grub_config();
+  }
+
+  return ok;
+}
+
+
+bool Install::grub_config()
+{
+  bool ok = false;
+
+  // other targets' partitions would be found
+  if (m_target.is_multi())
+    log_info("Not probing for other OSes when installing to several targets");
+
+  if (!m_target.is_multi() && !prepare_grub_probe())
+  {
+    // not a reason to stop: it's annoying for user but they can still have a working Arch
+    log_critical("Failed to setup for grub's os-prober");
+  }
+  else
+  {
+    ChRootCmd grub_config{m_target.root, "grub-mkconfig -o /boot/grub/grub.cfg", [this](const std::string_view out)
     {
-      if (!prepare_grub_probe())
-      {
-        // not a reason to stop: it's annoying for user but they can still have a working Arch
-        log_critical("Failed to setup for grub's os-prober");
-      }
-      else
-      {
-        ChRootCmd grub_config{"grub-mkconfig -o /boot/grub/grub.cfg", [this](const std::string_view out)
-        {
-          log_info(out);
-        }};
-  
-        if (r = grub_config.execute(); r != CmdSuccess)
-          log_critical(std::format("grub-mkconfig failed: {}", strerror(r)));
-        else
-          ok = true;
-      }
+      log_info(out);
+    }};
 
-      cleanup_grub_probe();
-    }
+    grub_config.set_limits(GrubDeadline);
+
+    if (const int r = grub_config.execute(); r != CmdSuccess)
+      log_critical(std::format("grub-mkconfig failed: {}", strerror(r)));
+    else
+      ok = true;
   }
 
+  cleanup_grub_probe();
+
   return ok;
 }
 
@@ -716,7 +1739,7 @@ bool Install::prepare_grub_probe()
   // GRUB_DISABLE_OS_PROBER is commented out, easier to just append
   bool updated_cfg{true}, mounted{true};
   
-  std::ofstream grub_cfg{RootMnt / fs::path{"etc/default/grub"}, std::ios_base::app};
+  std::ofstream grub_cfg{m_target.path("etc/default/grub"), std::ios_base::app};
   if (grub_cfg.good())
     grub_cfg << "GRUB_DISABLE_OS_PROBER=false";
   else
@@ -743,7 +1766,7 @@ bool Install::prepare_grub_probe()
       // ChRootCmd create_mnt_dir {std::format("mkdir {}", TmpMountPath.string())};
       // create_mnt_dir.execute();
       const auto parts = PartitionUtils::partitions();
-      const auto [_, mount_data] = Widgets::partitions()->get_data(); // '_' must be valid or we'd not be here
+      const auto& mount_data = m_mounts;
 
       unsigned int i = 0;
       for (const auto& part : parts)
@@ -757,9 +1780,9 @@ bool Install::prepare_grub_probe()
           const auto fs = part.fs_type == "ntfs" ? "ntfs3" : part.fs_type; // TODO unreliable hack?
 
           const auto mount_point = std::format("{}/{}", TmpMountPath.string(), i++);
-          const auto mount_cmd = std::format("mount --mkdir --read-only --target-prefix {} -t {} {} {}", RootMnt.string(), fs, part.dev, mount_point);
+          const auto mount_cmd = std::format("mount --mkdir --read-only --target-prefix {} -t {} {} {}", m_target.root.string(), fs, part.dev, mount_point);
           
-          if (ChRootCmd cmd{mount_cmd}; cmd.execute() != CmdSuccess)
+          if (ChRootCmd cmd{m_target.root, mount_cmd}; cmd.execute() != CmdSuccess)
           {
             log_warning(std::format("Failed to mount {} -> {}", part.dev, mount_point)); 
             mounted = false;
@@ -768,7 +1791,7 @@ bool Install::prepare_grub_probe()
           else
           {
             log_info(std::format("Mounted {} -> {}", part.dev, mount_point));
-            temp_mounts.emplace_back(mount_point);
+            m_temp_mounts.emplace_back(mount_point);
           }
         }
       }
@@ -781,47 +1804,47 @@ bool Install::prepare_grub_probe()
 
 void Install::cleanup_grub_probe()
 {
-  for (const auto& m : temp_mounts)
+  for (const auto& m : m_temp_mounts)
   {
     log_info(std::format("Unmounting: {}", m));
 
-    ChRootCmd cmd{std::format("umount -f {}", m)};
+    ChRootCmd cmd{m_target.root, std::format("umount -f {}", m)};
     cmd.execute();
   }
+
+  m_temp_mounts.clear();
 }
 
 
 // shell
 bool Install::shell()
 {
-  using namespace std::string_view_literals;
-
   const auto created_user = Widgets::accounts()->user_username();
   const auto user = created_user.empty() ? "root" : created_user;
   
   // Packages permits multiple shells, but the UI and this function only installs one
   const auto selected_shells = Packages::shells();
 
-  if (selected_shells.contains(Package{"bash"sv}))
+  if (selected_shells.contains("bash"))
   {
     log_info("bash selected, which is the default. Nothing to do");
   }
   else if (!selected_shells.empty()) // sanity
   {
-    const auto shell_name = selected_shells.cbegin()->name.toStdString();
+    const auto shell_name = selected_shells.names().front();
 
     log_info(std::format("Installing {}", shell_name));
 
     if (pacman_install(selected_shells))
     {
-      GetShellPath get_cmd{shell_name};
+      GetShellPath get_cmd{m_target.root, shell_name};
       if (const auto path = get_cmd.get_path(); path.empty())
         log_warning("Failed to get path for installed shell, can't change your shell. But it is installed");
       else
       {
         log_info(std::format("Changing shell for {} to {}", user, path.string()));
 
-        SetShell set_cmd{path, user};
+        SetShell set_cmd{m_target.root, path, user};
         if (set_cmd.execute() != CmdSuccess)
           log_warning("Failed to change shell, but it is installed.");
       }
@@ -858,14 +1881,13 @@ bool Install::profile()
   {
     // copy arch background
     std::error_code ec;
-    fs::create_directories(RootMnt / "usr/share/backgrounds", ec);
-    fs::copy_file("/root/wallpapers/bg.jpg", fs::path{RootMnt / "usr/share/backgrounds/arch.png"}, ec);
+    fs::create_directories(m_target.path("usr/share/backgrounds"), ec);
+    fs::copy_file("/root/wallpapers/bg.jpg", m_target.path("usr/share/backgrounds/arch.png"), ec);
 
 
     const auto& profile = Profiles::get_profile(profile_name);
     
-    run_sys_commands(profile.system_commands);
-    run_user_commands(profile.user_commands);
+    run_command_groups(profile.all_command_groups());
 
     // greeter, if any
     if (Packages::greeter().empty())
@@ -874,8 +1896,7 @@ bool Install::profile()
     {
       log_info (std::format("Installing packages for greeter {}", greeter_name.toStdString()));
 
-      run_sys_commands(Profiles::get_greeter(greeter_name).system_commands);
-      run_user_commands(Profiles::get_greeter(greeter_name).user_commands);
+      run_command_groups(Profiles::get_greeter(greeter_name).all_command_groups());
     }
     else
       log_warning("Greeter failed to install, you will likely be in tty");
@@ -885,34 +1906,41 @@ bool Install::profile()
 }
 
 
-void Install::run_sys_commands(const QStringList& commands)
+void Install::run_command_groups(const std::vector<CommandGroup>& profile_groups)
 {
-  log_info(std::format("Executing {} system commands", commands.size()));
-
-  ChRootCmd chroot{commands};
-  if (chroot.execute() != CmdSuccess)
+  // "systemctl enable" in system groups is done without the chroot, before the groups
+  // run. If that fails, the command remains for systemctl
+  auto groups = profile_groups;
+  UnitEnabler enabler{m_target.root};
+  
+  for (auto& group : groups)
   {
-    log_critical("System command failed");
-  }
-}
+    if (group.user)
+      continue;
 
+    group.commands.removeIf([this, &enabler](const QString& cmd)
+    {
+      const auto units = UnitEnabler::parse_enable_command(cmd.toStdString());
+      const bool enabled = !units.empty() && enabler.enable(units);
+      
+      if (enabled)
+        log_info(std::format("Enabled without chroot: {}", cmd.toStdString()));
 
-void Install::run_user_commands(const QStringList& commands)
-{
-  const auto username = Widgets::accounts()->user_username();
+      return enabled;
+    });
+  }
 
-  if (!username.empty() && !commands.empty())
-  {
-    log_info("Executing user commands");
+  log_info(std::format("Executing {} command groups", groups.size()));
 
-    ChRootCmd chroot{commands, username};
-    
-    if (chroot.execute() != CmdSuccess)
-    //if (!chroot.execute_commands(username, commands))
-    {
-      log_warning("At least one user command failed");
-    }
-  }
+  CommandGroupRunner runner {m_target.root,
+                             Widgets::accounts()->user_username(),
+                             std::bind_front(&Install::log_info, this),
+                             std::bind_front(&Install::log_warning, this)};
+  
+  if (!runner.run(groups))
+    log_critical("Command groups failed");
+  else if (const auto& results = runner.results(); std::any_of(results.cbegin(), results.cend(), [](const CommandResult& r){ return r.exit_code != 0; }))
+    log_warning("At least one command failed");
 }
 
 
@@ -935,7 +1963,13 @@ bool Install::enable_service(const std::string_view name)
 {
   log_info(std::format("Enabling service {}", name));
 
-  ChRootCmd cmd{std::format("systemctl enable {}", name)};
+  // create the symlinks directly, only chroot if that fails
+  if (UnitEnabler enabler{m_target.root}; enabler.enable(name))
+    return true;
+  
+  log_info("Offline enable failed, using systemctl");
+
+  ChRootCmd cmd{m_target.root, std::format("systemctl enable {}", name)};
   
   const int r = cmd.execute();  
   if (r != CmdSuccess)
@@ -1002,17 +2036,20 @@ bool Install::pacman_install(const PackageSet& packages)
   log_info(std::format("Installing {} packages", packages.size()));
 
   std::stringstream ss;
-  ss << "pacman -S --noconfirm " << packages;
+  // --needed: a deployed image already has most packages, i.e. grub
+  ss << "pacman -S --needed --noconfirm " << packages;
 
   const auto install_cmd = ss.str();
 
   qInfo() << install_cmd;
 
-  ChRootCmd install {install_cmd, [this](const std::string_view out)
+  ChRootCmd install {m_target.root, install_cmd, [this](const std::string_view out)
   {
     log_info(out);
   }};
 
+  install.set_limits(std::chrono::seconds{0}, PacmanStallLimit);
+
   if (const int r = install.execute(); r != CmdSuccess)
   {
     log_critical(std::format("pacman install of packages failed with code: {}", r));
@@ -1025,9 +2062,5 @@ bool Install::pacman_install(const PackageSet& packages)
 
 bool Install::pacman_install(const QStringList& packages)
 {
-  PackageSet ps;
-  for (const auto& p : packages)
-    ps.emplace(Package{p.toStdString()});
-  
-  return pacman_install(ps);
+  return pacman_install(Packages::make_set(packages));
 }
\ No newline at end of file
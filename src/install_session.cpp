@@ -0,0 +1,147 @@
+#include <ali/install_session.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <QDebug>
+
+
+static const fs::path CpuFreqPath {"/sys/devices/system/cpu/cpufreq"};
+static constexpr std::string_view Governor {"performance"};
+
+
+static std::string read_line(const fs::path& path)
+{
+  std::string line;
+  if (std::ifstream stream{path}; stream.good())
+    std::getline(stream, line);
+  return line;
+}
+
+
+// sysfs reports an invalid value when written, so flush before checking
+static bool write_line(const fs::path& path, const std::string_view value)
+{
+  std::ofstream stream{path};
+  stream << value << std::flush;
+  return stream.good();
+}
+
+
+// "noatime" in "subvol=@,noatime,space_cache=v2"
+static bool has_option(const std::string_view options, const std::string_view name)
+{
+  std::istringstream stream{std::string{options}};
+  for (std::string option; std::getline(stream, option, ','); )
+  {
+    if (option == name)
+      return true;
+  }
+  return false;
+}
+
+
+// "performance powersave"
+static bool has_governor(const std::string& available)
+{
+  std::istringstream stream{available};
+  for (std::string governor; stream >> governor; )
+  {
+    if (governor == Governor)
+      return true;
+  }
+  return false;
+}
+
+
+InstallSession::InstallSession()
+{
+  std::scoped_lock lock{m_mutex};
+
+  if (m_count++ > 0)
+    return;
+
+  // a policy per group of CPUs which share a clock
+  std::error_code ec;
+  for (const auto& policy : fs::directory_iterator{CpuFreqPath, ec})
+  {
+    const auto current = read_line(policy.path() / "scaling_governor");
+    const auto available = read_line(policy.path() / "scaling_available_governors");
+
+    if (current.empty() || current == Governor || !has_governor(available))
+      continue;
+
+    if (write_line(policy.path() / "scaling_governor", Governor))
+      m_governors.emplace(policy.path(), current);
+    else
+      qWarning() << "Failed to set governor of " << policy.path().string();
+  }
+
+  if (!m_governors.empty())
+    qInfo() << "CPU governor is " << Governor << " for " << m_governors.size() << " policies";
+}
+
+
+InstallSession::~InstallSession()
+{
+  std::scoped_lock lock{m_mutex};
+
+  if (--m_count > 0)
+    return;
+
+  for (const auto& [policy, governor] : m_governors)
+  {
+    if (!write_line(policy / "scaling_governor", governor))
+      qWarning() << "Failed to restore governor of " << policy.string();
+  }
+
+  m_governors.clear();
+}
+
+
+std::string InstallSession::mount_options(const std::string_view fs, const std::string_view persistent)
+{
+  if (!has_barrier_option(fs))
+    return std::string{persistent};
+  else if (persistent.empty())
+    return "nobarrier";
+  else
+    return std::format("{},nobarrier", persistent);
+}
+
+
+// noatime and lazytime are set by MountFlags, but appear in the mount table as options
+std::vector<std::string> InstallSession::session_options(const std::string_view fs, const std::string_view persistent)
+{
+  std::vector<std::string> options {"lazytime"};
+
+  // i.e. the btrfs profile's noatime
+  if (!has_option(persistent, "noatime"))
+    options.emplace_back("noatime");
+
+  if (has_barrier_option(fs))
+    options.emplace_back("nobarrier");
+
+  return options;
+}
+
+
+bool InstallSession::end_mount(const std::string_view dev, const fs::path& path, const std::string_view fs)
+{
+  if (!has_barrier_option(fs))
+    return true;
+
+  // other options are kept by a remount
+  if (::mount(std::string{dev}.c_str(), path.c_str(), std::string{fs}.c_str(), MS_REMOUNT | MountFlags, "barrier") != 0)
+  {
+    qWarning() << "Failed to restore barriers on " << path.string() << ": " << ::strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+
+bool InstallSession::has_barrier_option(const std::string_view fs)
+{
+  return fs == "ext4" || fs == "btrfs";
+}
@@ -1,5 +1,4 @@
 #include <ali/locale_utils.hpp>
-#include <ali/disk_utils.hpp> // for RootMnt
 #include <ali/commands.hpp>
 #include <QDebug>
 #include <fstream>
@@ -24,11 +23,11 @@ static const char LocaleGenIntro[] = R"(# Configuration file for locale-gen
 #)";
 
 
-// these paths use RootMnt (/mnt) because they are used outside of chroot, with
-// std::filesystem and std::fstream functions
+// the installed paths are relative to the target root (i.e. /mnt) because they are used
+// outside of chroot, with std::filesystem and std::fstream functions
 static const fs::path LiveLocaleGenPath {"/usr/share/i18n/SUPPORTED"};
-static const fs::path InstalledLocaleGenPath {RootMnt / "etc/locale.gen"};
-static const fs::path InstalledLocaleConfPath {RootMnt / "etc/locale.conf"};
+static const fs::path InstalledLocaleGenPath {"etc/locale.gen"};
+static const fs::path InstalledLocaleConfPath {"etc/locale.conf"};
 static const fs::path TimezonePath {"/etc/localtime"};
 
 QStringList LocaleUtils::m_locales;
@@ -99,13 +98,13 @@ bool LocaleUtils::read_keymaps()
 }
 
 
-bool LocaleUtils::generate_locale(const QStringList& user_locales, const QString& current)
+bool LocaleUtils::generate_locale(const fs::path& root, const QStringList& user_locales, const QString& current)
 {
   bool ok {false};
 
-  if (write_locale_gen(user_locales))
+  if (write_locale_gen(root, user_locales))
   {
-    if (ChRootCmd cmd_gen{std::format("locale-gen")}; cmd_gen.execute() == CmdSuccess)
+    if (ChRootCmd cmd_gen{root, std::format("locale-gen")}; cmd_gen.execute() == CmdSuccess)
     {
       const auto cmd_string = std::format("localectl set-locale {}", current.toStdString());
 
@@ -113,10 +112,10 @@ bool LocaleUtils::generate_locale(const QStringList& user_locales, const QString
       
       try
       {
-        std::ofstream stream{InstalledLocaleConfPath, std::ios_base::out | std::ios_base::trunc};
+        std::ofstream stream{root / InstalledLocaleConfPath, std::ios_base::out | std::ios_base::trunc};
         stream << "LANG=" << current.toStdString() << '\n';
         
-        ChRootCmd set_locale{cmd_string};
+        ChRootCmd set_locale{root, cmd_string};
         ok = set_locale.execute() == CmdSuccess && stream.good();
       }
       catch(const std::exception& e)
@@ -130,7 +129,7 @@ bool LocaleUtils::generate_locale(const QStringList& user_locales, const QString
 }
 
 
-bool LocaleUtils::write_locale_gen(const QStringList& user_locales)
+bool LocaleUtils::write_locale_gen(const fs::path& root, const QStringList& user_locales)
 {
   // write out the intro section from the ISO file,
   // the locales selected, then the original commented locales
@@ -138,7 +137,7 @@ bool LocaleUtils::write_locale_gen(const QStringList& user_locales)
   bool set{true};
   try
   {
-    std::ofstream stream{InstalledLocaleGenPath, std::ios_base::out | std::ios_base::trunc};
+    std::ofstream stream{root / InstalledLocaleGenPath, std::ios_base::out | std::ios_base::trunc};
     stream << LocaleGenIntro << '\n';
     
     for (const auto& l : user_locales)
@@ -159,16 +158,16 @@ bool LocaleUtils::write_locale_gen(const QStringList& user_locales)
 }
 
 
-bool LocaleUtils::generate_keymap(const std::string& keys, const bool gen_x11_keymap)
+bool LocaleUtils::generate_keymap(const fs::path& root, const std::string& keys, const bool gen_x11_keymap)
 {
   static const std::string_view XKBConf = "00-keyboard.conf";
   static const fs::path LiveX11KeyboardConfDir = "etc/X11/xorg.conf.d";
 
   static const fs::path LiveX11KeyboardConfPath {"/" / LiveX11KeyboardConfDir / XKBConf};
-  static const fs::path InstalledX11KeyboardConfPath {RootMnt / LiveX11KeyboardConfDir / XKBConf};
+  const fs::path InstalledX11KeyboardConfPath {root / LiveX11KeyboardConfDir / XKBConf};
 
   static const fs::path LiveVirtualConsolePath {"/etc/vconsole.conf"};
-  static const fs::path InstalledVirtualConsolePath {RootMnt / "etc/vconsole.conf"};
+  const fs::path InstalledVirtualConsolePath {root / "etc/vconsole.conf"};
 
   // arguably a bit hacky: we can't use `localectl set-keymap` in chroot
   // because there is not a proper/full dbus running. So instead
@@ -203,12 +202,12 @@ bool LocaleUtils::generate_keymap(const std::string& keys, const bool gen_x11_ke
 }
 
 
-bool LocaleUtils::generate_timezone(const std::string& zone)
+bool LocaleUtils::generate_timezone(const fs::path& root, const std::string& zone)
 {
-  ChRootCmd set_cmd{std::format("ln -sf /usr/share/zoneinfo/{} {}", zone, TimezonePath.string())};
+  ChRootCmd set_cmd{root, std::format("ln -sf /usr/share/zoneinfo/{} {}", zone, TimezonePath.string())};
   if (set_cmd.execute() == CmdSuccess)
   {
-    ChRootCmd set_hw_clock{"hwclock --systohc"};
+    ChRootCmd set_hw_clock{root, "hwclock --systohc"};
     return set_hw_clock.execute() == CmdSuccess;
   }
 
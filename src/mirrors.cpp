@@ -0,0 +1,144 @@
+#include <ali/mirrors.hpp>
+#include <ali/commands.hpp>
+#include <ali/file_utils.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <QDebug>
+
+
+std::shared_future<MirrorResults> Mirrors::m_ranked;
+
+
+void Mirrors::rank_async()
+{
+  static std::once_flag once;
+  std::call_once(once, []
+  {
+    m_ranked = std::async(std::launch::async, &Mirrors::rank, LiveMirrorList).share();
+  });
+}
+
+
+std::optional<MirrorResults> Mirrors::ranked()
+{
+  if (m_ranked.valid() && m_ranked.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+  {
+    if (const auto& mirrors = m_ranked.get(); !mirrors.empty())
+      return mirrors;
+  }
+  return std::nullopt;
+}
+
+
+bool Mirrors::write(const fs::path& path, const MirrorResults& mirrors)
+{
+  std::stringstream content;
+  content << "# Ranked by ali: fastest first\n";
+
+  for (const auto& mirror : mirrors)
+    content << std::format("# {}/s, {:.0f}ms\nServer = {}\n", format_size(mirror.speed), mirror.latency * 1000, mirror.server);
+
+  return FileUtils::write_atomic(path, content.str());
+}
+
+
+MirrorResults Mirrors::rank(const fs::path& mirrorlist)
+{
+  const auto candidates = read_candidates(mirrorlist);
+
+  qInfo() << "Ranking " << candidates.size() << " mirrors";
+
+  MirrorResults results;
+  results.reserve(candidates.size());
+
+  // extra.db is several MB, so the range is a transfer rather than mostly the connection's
+  // setup, and exists on all mirrors. core.db is smaller than ProbeBytes
+  auto probe = [](const std::string& server)
+  {
+    std::string url{server};
+
+    if (const auto pos = url.find("$repo"); pos != std::string::npos)
+      url.replace(pos, 5, "extra");
+    if (const auto pos = url.find("$arch"); pos != std::string::npos)
+      url.replace(pos, 5, "x86_64");
+    
+    DownloadSpeed cmd{url + "/extra.db", ProbeBytes, ProbeTimeout};
+    const auto speed = cmd.get_speed();
+    
+    return MirrorResult{.server = server, .speed = speed, .latency = cmd.get_latency()};
+  };
+
+  // in batches to limit concurrent connections
+  for (std::size_t i = 0 ; i < candidates.size() ; i += MaxConcurrent)
+  {
+    std::vector<std::future<MirrorResult>> probes;
+
+    for (std::size_t j = i ; j < std::min(i + MaxConcurrent, candidates.size()) ; ++j)
+      probes.push_back(std::async(std::launch::async, probe, candidates[j]));
+    
+    for (auto& f : probes)
+    {
+      if (auto result = f.get(); result.speed)
+        results.push_back(std::move(result));
+    }
+  }
+  
+  std::sort(results.begin(), results.end(), [](const MirrorResult& a, const MirrorResult& b)
+  {
+    return a.speed != b.speed ? a.speed > b.speed : a.latency < b.latency;
+  });
+
+  if (results.size() > BestCount)
+    results.resize(BestCount);
+
+  for (const auto& mirror : results)
+    qInfo() << "Mirror: " << mirror.server << " " << format_size(mirror.speed) << "/s " << mirror.latency << "s";
+
+  return results;
+}
+
+
+std::vector<std::string> Mirrors::read_candidates(const fs::path& path)
+{
+  // both enabled and commented servers are candidates, enabled first
+  std::vector<std::string> enabled, disabled;
+
+  if (std::ifstream stream{path}; stream.good())
+  {
+    for (std::string line; std::getline(stream, line); )
+    {
+      const bool commented = line.starts_with('#');
+      const auto start = line.find_first_not_of("# ");
+
+      if (start == std::string::npos)
+        continue;
+      
+      const std::string_view entry = std::string_view{line}.substr(start);
+      
+      if (!entry.starts_with("Server"))
+        continue;
+      
+      if (const auto pos = entry.find_first_not_of(" =", entry.find('=')); pos != std::string_view::npos)
+      {
+        auto& servers = commented ? disabled : enabled;
+        if (std::string server{entry.substr(pos)}; std::find(servers.cbegin(), servers.cend(), server) == servers.cend())
+          servers.push_back(std::move(server));
+      }
+    }
+  }
+
+  // a server which is enabled and also commented is ranked once, as enabled
+  std::erase_if(disabled, [&enabled](const std::string& server)
+  {
+    return std::find(enabled.cbegin(), enabled.cend(), server) != enabled.cend();
+  });
+
+  enabled.insert(enabled.end(), disabled.begin(), disabled.end());
+
+  if (enabled.size() > MaxCandidates)
+    enabled.resize(MaxCandidates);
+
+  return enabled;
+}
@@ -0,0 +1,150 @@
+#include <ali/package_estimator.hpp>
+#include <ali/packages.hpp>
+#include <ali/sync_db.hpp>
+#include <ali/commands.hpp>
+#include <unordered_set>
+#include <fstream>
+#include <mutex>
+#include <QDebug>
+
+
+std::shared_future<uint64_t> PackageEstimator::m_speed;
+
+
+std::optional<PackageEstimate> PackageEstimator::estimate(const std::vector<std::string>& names)
+{
+  if (!SyncDb::is_ready())
+    return std::nullopt;
+
+  PackageEstimate estimate;
+  std::unordered_set<const SyncPackage *> visited;
+  std::vector<const SyncPackage *> pending;
+
+  auto add = [&visited, &pending](const SyncPackage * pkg)
+  {
+    if (visited.insert(pkg).second)
+      pending.push_back(pkg);
+  };
+
+  for (const auto& name : names)
+  {
+    if (const auto pkg = SyncDb::find_provider(name); pkg)
+      add(pkg);
+    else if (const auto group = SyncDb::group(name); !group.empty())
+    {
+      // pacstrap installs all packages in a group
+      for (const auto pkg : group)
+        add(pkg);
+    }
+    else
+      estimate.unresolved.push_back(name);
+  }
+
+  while (!pending.empty())
+  {
+    const auto pkg = pending.back();
+    pending.pop_back();
+
+    estimate.download_size += pkg->download_size;
+    estimate.installed_size += pkg->installed_size;
+
+    for (const auto dep_id : SyncDb::ids(pkg->depends))
+    {
+      if (const auto dep = SyncDb::find_provider(SyncDb::str(dep_id)); dep)
+        add(dep);
+      else
+        estimate.unresolved.emplace_back(SyncDb::str(dep_id));
+    }
+  }
+
+  estimate.packages = visited.size();
+  
+  return estimate;
+}
+
+
+std::optional<PackageEstimate> PackageEstimator::estimate_selected()
+{
+  return estimate(Packages::all_names());
+}
+
+
+void PackageEstimator::measure_speed_async()
+{
+  static std::once_flag once;
+  std::call_once(once, []
+  {
+    m_speed = std::async(std::launch::async, &PackageEstimator::measure_speed).share();
+  });
+}
+
+
+std::optional<uint64_t> PackageEstimator::download_speed()
+{
+  if (m_speed.valid() && m_speed.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+  {
+    if (const auto speed = m_speed.get(); speed)
+      return speed;
+  }
+  return std::nullopt;
+}
+
+
+std::optional<std::chrono::seconds> PackageEstimator::eta(const PackageEstimate& estimate)
+{
+  if (const auto speed = download_speed(); speed)
+    return std::chrono::seconds{estimate.download_size / *speed};
+  else
+    return std::nullopt;
+}
+
+
+uint64_t PackageEstimator::measure_speed()
+{
+  // the extra db is several MB so a reasonable sample, and exists on all mirrors
+  const auto url = first_mirror_url("extra", "extra.db");
+
+  if (url.empty())
+  {
+    qWarning() << "No mirror in " << MirrorListPath.string() << ", cannot measure download speed";
+    return 0;
+  }
+
+  DownloadSpeed cmd{url};
+  const auto speed = cmd.get_speed();
+
+  qInfo() << "Download speed from " << url << ": " << speed << " bytes/s";
+  
+  return speed;
+}
+
+
+std::string PackageEstimator::first_mirror_url(const std::string_view repo, const std::string_view file)
+{
+  // "Server = https://mirror.example.com/archlinux/$repo/os/$arch"
+  if (std::ifstream stream{MirrorListPath}; stream.good())
+  {
+    for (std::string line; std::getline(stream, line); )
+    {
+      if (!line.starts_with("Server"))
+        continue;
+      
+      if (const auto pos = line.find_first_not_of(" =", line.find('=')); pos != std::string::npos)
+      {
+        std::string url = line.substr(pos);
+
+        auto replace = [&url](const std::string_view var, const std::string_view value)
+        {
+          if (const auto pos = url.find(var); pos != std::string::npos)
+            url.replace(pos, var.size(), value);
+        };
+
+        replace("$repo", repo);
+        replace("$arch", "x86_64");
+
+        return std::format("{}/{}", url, file);
+      }
+    }
+  }
+  return {};
+}
@@ -1,12 +1,184 @@
 #include <ali/packages.hpp>
+#include <algorithm>
 
-std::set<Package, PackageCmp> Packages::m_kernels;
-std::set<Package, PackageCmp> Packages::m_required;
-std::set<Package, PackageCmp> Packages::m_firmware;
-std::set<Package, PackageCmp> Packages::m_important;
-std::set<Package, PackageCmp> Packages::m_shells;
-std::set<Package, PackageCmp> Packages::m_profile;
-std::set<Package, PackageCmp> Packages::m_video;
-std::set<Package, PackageCmp> Packages::m_greeter;
-std::set<Package, PackageCmp> Packages::m_additional;
 
+std::vector<std::string> Packages::m_names;
+std::vector<PackageCategories> Packages::m_categories;
+std::vector<PackageId> Packages::m_sorted;
+
+
+bool PackageSet::contains(const std::string_view name) const
+{
+  std::shared_lock lock{Packages::m_mutex};
+
+  // m_ids is sorted by name
+  const auto it = std::lower_bound(m_ids.cbegin(), m_ids.cend(), name, [](const PackageId id, const std::string_view name)
+  {
+    return Packages::m_names[id] < name;
+  });
+  return it != m_ids.cend() && Packages::m_names[*it] == name;
+}
+
+
+std::string Packages::name(const PackageId id)
+{
+  std::shared_lock lock{m_mutex};
+  return m_names[id];
+}
+
+
+PackageSet Packages::get(const std::initializer_list<PackageCategory> categories)
+{
+  PackageCategories mask;
+  for (const auto c : categories)
+    mask.set(index(c));
+
+  std::shared_lock lock{m_mutex};
+  
+  // m_sorted is sorted and unique, so the result is too
+  PackageSet ps;
+  for (const auto id : m_sorted)
+  {
+    if ((m_categories[id] & mask).any())
+      ps.m_ids.push_back(id);
+  }
+  return ps;
+}
+
+
+PackageSet Packages::all()
+{
+  std::shared_lock lock{m_mutex};
+
+  PackageSet ps;
+  for (const auto id : m_sorted)
+  {
+    if (m_categories[id].any())
+      ps.m_ids.push_back(id);
+  }
+  return ps;
+}
+
+
+PackageSet Packages::make_set(const QStringList& names)
+{
+  std::unique_lock lock{m_mutex};
+
+  PackageSet ps;
+  for (const auto& name : names)
+    ps.m_ids.push_back(intern(name));
+
+  std::sort(ps.m_ids.begin(), ps.m_ids.end(), [](const PackageId a, const PackageId b){ return m_names[a] < m_names[b]; });
+  ps.m_ids.erase(std::unique(ps.m_ids.begin(), ps.m_ids.end()), ps.m_ids.end());
+  return ps;
+}
+
+
+bool Packages::have_package(const std::string_view name)
+{
+  std::shared_lock lock{m_mutex};
+
+  const auto id = find(name);
+  return id && m_categories[*id].any();
+}
+
+
+std::vector<std::string> Packages::all_names()
+{
+  // names() views the set, which must outlive the loop
+  const auto set = all();
+
+  std::vector<std::string> names;
+  for (const auto& name : set.names())
+    names.push_back(name);
+  return names;
+}
+
+
+void Packages::dump(QDebug& q)
+{
+  static const char * Names[] = {"Kernels", "Required", "Firmware", "Important", "Shells", "Profile", "Video", "Greeter", "Additional"};
+
+  for (std::size_t c = 0 ; c < index(PackageCategory::Max) ; ++c)
+  {
+    q << Names[c] << ":\n";
+
+    const auto set = get(static_cast<PackageCategory>(c));
+    for (const auto& name : set.names())
+      q << name.c_str() << '\n';
+  }
+}
+
+
+PackageId Packages::intern(const std::string_view name)
+{
+  if (const auto id = find(name); id)
+    return *id;
+
+  const auto id = static_cast<PackageId>(m_names.size());
+  m_names.emplace_back(name);
+  m_categories.emplace_back();
+
+  const auto pos = std::lower_bound(m_sorted.begin(), m_sorted.end(), name, [](const PackageId id, const std::string_view name)
+  {
+    return m_names[id] < name;
+  });
+  m_sorted.insert(pos, id);
+
+  return id;
+}
+
+
+const PackageId * Packages::find(const std::string_view name)
+{
+  const auto it = std::lower_bound(m_sorted.cbegin(), m_sorted.cend(), name, [](const PackageId id, const std::string_view name)
+  {
+    return m_names[id] < name;
+  });
+
+  return it != m_sorted.cend() && m_names[*it] == name ? &(*it) : nullptr;
+}
+
+
+void Packages::add(const QStringList& names, const PackageCategory c)
+{
+  std::unique_lock lock{m_mutex};
+
+  for (const auto& name : names)
+    m_categories[intern(name)].set(index(c));
+}
+
+
+void Packages::remove(const QStringList& names, const PackageCategory c)
+{
+  std::unique_lock lock{m_mutex};
+
+  for (const auto& name : names)
+  {
+    if (const auto id = find(name.toStdString()); id)
+      m_categories[*id].reset(index(c));
+  }
+}
+
+
+void Packages::set(const QStringList& names, const PackageCategory c)
+{
+  std::unique_lock lock{m_mutex};
+
+  for (auto& categories : m_categories)
+    categories.reset(index(c));
+  
+  for (const auto& name : names)
+    m_categories[intern(name)].set(index(c));
+}
+
+
+bool Packages::have(const PackageCategory c)
+{
+  std::shared_lock lock{m_mutex};
+
+  return std::any_of(m_categories.cbegin(), m_categories.cend(), [c](const PackageCategories& categories)
+  {
+    return categories.test(index(c));
+  });
+}
@@ -0,0 +1,109 @@
+#include <ali/pacman_conf.hpp>
+#include <ali/file_utils.hpp>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <QDebug>
+
+
+PacmanSettings PacmanSettings::from_speed(const std::optional<uint64_t> speed)
+{
+  static const uint64_t MB = 1024 * 1024;
+
+  PacmanSettings settings;
+
+  if (!speed)
+    return settings;  // default is fine
+  
+  if (*speed < MB / 4)
+  {
+    settings.parallel_downloads = 3;
+    settings.disable_download_timeout = true;
+  }
+  else if (*speed < 2 * MB)
+    settings.parallel_downloads = 5;
+  else if (*speed < 10 * MB)
+    settings.parallel_downloads = 10;
+  else
+    settings.parallel_downloads = 16;
+  
+  return settings;
+}
+
+
+bool PacmanConf::apply(const fs::path& path, const PacmanSettings& settings)
+{
+  std::vector<std::string> lines;
+
+  if (std::ifstream stream{path}; !stream.good())
+  {
+    qCritical() << "Failed to open " << path.string();
+    return false;
+  }
+  else
+  {
+    for (std::string line; std::getline(stream, line); )
+      lines.push_back(std::move(line));
+  }
+  
+  // match "Key", "Key = x", "#Key", "#Key = x"
+  auto is_key = [](const std::string_view line, const std::string_view key)
+  {
+    const auto start = line.find_first_not_of("# ");
+    if (start == std::string_view::npos)
+      return false;
+    
+    const auto entry = line.substr(start);
+    return entry.substr(0, entry.find_first_of(" =")) == key;
+  };
+
+  const std::string parallel = std::format("ParallelDownloads = {}", settings.parallel_downloads);
+  const std::string timeout = settings.disable_download_timeout ? "DisableDownloadTimeout" : "#DisableDownloadTimeout";
+
+  bool in_options{false}, have_options{false}, have_parallel{false}, have_timeout{false};
+  std::size_t options_end{lines.size()};
+
+  for (std::size_t i = 0 ; i < lines.size() ; ++i)
+  {
+    auto& line = lines[i];
+
+    if (line.starts_with('['))
+    {
+      if (in_options)
+        options_end = i;
+
+      in_options = line.starts_with("[options]");
+      have_options |= in_options;
+    }
+    else if (!in_options)
+      continue;
+    else if (is_key(line, "ParallelDownloads"))
+    {
+      line = parallel;
+      have_parallel = true;
+    }
+    else if (is_key(line, "DisableDownloadTimeout"))
+    {
+      line = timeout;
+      have_timeout = true;
+    }
+  }
+
+  if (!have_options)
+  {
+    qCritical() << path.string() << " has no [options] section";
+    return false;
+  }
+
+  // not present (even commented), add to end of [options]
+  if (!have_timeout && settings.disable_download_timeout)
+    lines.insert(lines.begin() + options_end, timeout);
+  if (!have_parallel)
+    lines.insert(lines.begin() + options_end, parallel);
+
+  std::stringstream content;
+  for (const auto& line : lines)
+    content << line << '\n';
+
+  return FileUtils::write_atomic(path, content.str());
+}
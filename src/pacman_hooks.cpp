@@ -0,0 +1,156 @@
+#include <ali/pacman_hooks.hpp>
+#include <algorithm>
+#include <QDebug>
+
+
+static const fs::path NullDevice {"/dev/null"};
+static const fs::path SystemHooksDir {"usr/share/libalpm/hooks"};  // packages' hooks, relative to the root
+
+static constexpr std::string_view DkmsHook {"70-dkms-install"};
+static constexpr std::string_view MkinitcpioHook {"90-mkinitcpio-install"};
+
+// The hook file names (without ".hook"), and the hook's action when run once for all
+// packages. DKMS and mkinitcpio run per kernel.
+static const std::vector<std::pair<std::string_view, std::string_view>> Hooks
+{
+  {DkmsHook,                  ""},
+  {MkinitcpioHook,            ""},
+  {"man-db",                  "mandb --quiet"},
+  {"fontconfig",              "fc-cache -s"},
+  {"gtk-update-icon-cache",   R"(for theme in /usr/share/icons/*/; do if [ -f "$theme/index.theme" ]; then gtk-update-icon-cache -q -t -f "$theme"; fi; done)"},
+  {"update-desktop-database", "update-desktop-database --quiet"}
+};
+
+
+static fs::path hook_file(const fs::path& dir, const std::string_view name)
+{
+  return dir / std::format("{}.hook", name);
+}
+
+
+bool PacmanHooks::defer(const fs::path& root)
+{
+  const fs::path dir {root / HooksDir};
+
+  std::error_code ec;
+  if (fs::create_directories(dir, ec); ec)
+  {
+    qCritical() << "Failed to create " << dir.string() << ": " << ec.message();
+    return false;
+  }
+
+  for (const auto& [name, command] : Hooks)
+  {
+    const auto mask = hook_file(dir, name);
+
+    // masked by a previous attempt, or overridden by something else which is left alone
+    if (const auto status = fs::symlink_status(mask, ec); fs::is_symlink(status))
+      continue;
+    else if (fs::exists(status))
+    {
+      qWarning() << "Not deferring " << mask.string() << ", it already exists";
+      continue;
+    }
+
+    if (fs::create_symlink(NullDevice, mask, ec); ec)
+    {
+      qCritical() << "Failed to mask " << mask.string() << ": " << ec.message();
+      restore(root);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+void PacmanHooks::restore(const fs::path& root)
+{
+  const fs::path dir {root / HooksDir};
+
+  for (const auto& [name, command] : Hooks)
+  {
+    const auto mask = hook_file(dir, name);
+
+    std::error_code ec;
+    if (fs::is_symlink(mask, ec) && fs::read_symlink(mask, ec) == NullDevice)
+      fs::remove(mask, ec);
+  }
+}
+
+
+std::string PacmanHooks::hookdir_option(const fs::path& root)
+{
+  return std::format("--hookdir {}/", (root / HooksDir).string());
+}
+
+
+std::vector<CommandGroup> PacmanHooks::groups(const fs::path& root)
+{
+  // a package's hook is only run if the package is installed
+  auto installed = [dir = root / SystemHooksDir](const std::string_view name)
+  {
+    std::error_code ec;
+    return fs::exists(hook_file(dir, name), ec);
+  };
+
+  const auto versions = kernels(root);
+
+  std::vector<CommandGroup> groups;
+  QStringList after;
+
+  // alone in its wave: modules for different kernels share a build directory
+  if (installed(DkmsHook) && !versions.empty())
+  {
+    CommandGroup dkms{.name = "dkms"};
+
+    for (const auto& version : versions)
+      dkms.commands.append(QString::fromStdString(std::format("dkms autoinstall -k {}", version)));
+
+    after.append(dkms.name);
+    groups.push_back(std::move(dkms));
+  }
+
+  // the hook's script installs the kernel to /boot, creates the preset, then the initramfs.
+  // It reads the kernel's paths relative to /
+  if (installed(MkinitcpioHook))
+  {
+    for (const auto& version : versions)
+    {
+      groups.push_back(CommandGroup{.name = QString::fromStdString(std::format("{} {}", InitramfsGroup, version)),
+                                    .commands = {QString::fromStdString(std::format("cd / && echo usr/lib/modules/{}/vmlinuz | /usr/share/libalpm/scripts/mkinitcpio install", version))},
+                                    .after = after,
+                                    .parallel = true});
+    }
+  }
+
+  for (const auto& [name, command] : Hooks)
+  {
+    if (!command.empty() && installed(name))
+    {
+      groups.push_back(CommandGroup{.name = QString::fromUtf8(name.data(), name.size()),
+                                    .commands = {QString::fromUtf8(command.data(), command.size())},
+                                    .after = after,
+                                    .parallel = true});
+    }
+  }
+
+  return groups;
+}
+
+
+// each kernel package has a directory in /usr/lib/modules, with its image and package name
+std::vector<std::string> PacmanHooks::kernels(const fs::path& root)
+{
+  std::vector<std::string> versions;
+
+  std::error_code ec;
+  for (const auto& dir : fs::directory_iterator{root / "usr/lib/modules", ec})
+  {
+    if (fs::exists(dir.path() / "vmlinuz", ec) && fs::exists(dir.path() / "pkgbase", ec))
+      versions.push_back(dir.path().filename().string());
+  }
+
+  std::sort(versions.begin(), versions.end());
+  return versions;
+}
@@ -0,0 +1,239 @@
+#include <ali/partitioner.hpp>
+#include <libfdisk/libfdisk.h>
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+
+
+// Context for a device, unassigned and released on destruction
+struct FdiskDevice
+{
+  FdiskDevice(const std::string_view dev, const bool read_only = false)
+  {
+    if (cxt = fdisk_new_context(); cxt)
+    {
+      if (const int r = fdisk_assign_device(cxt, std::string{dev}.c_str(), read_only ? 1 : 0); r != 0)
+      {
+        qCritical() << "fdisk: failed to open " << dev << ": " << strerror(-r);
+        fdisk_unref_context(cxt);
+        cxt = nullptr;
+      }
+      else
+      {
+        // no interactive prompts
+        fdisk_disable_dialogs(cxt, 1);
+      }
+    }
+  }
+
+  ~FdiskDevice()
+  {
+    if (cxt)
+    {
+      fdisk_deassign_device(cxt, 0);
+      fdisk_unref_context(cxt);
+    }
+  }
+
+  bool valid() const { return cxt != nullptr; }
+
+  fdisk_context * cxt{nullptr};
+};
+
+
+// PartitionPlan
+PartitionPlan PartitionPlan::create_default(const std::string_view dev, const uint64_t disk_size, const bool separate_home, const uint64_t swap_size)
+{
+  PartitionPlan plan {.dev = std::string{dev}};
+
+  plan.parts.emplace_back(Part{.role = PartitionRole::Efi, .size = EfiSize});
+
+  if (swap_size)
+    plan.parts.emplace_back(Part{.role = PartitionRole::Swap, .size = swap_size});
+
+  const uint64_t used = EfiSize + swap_size;
+  const uint64_t remaining = disk_size > used ? disk_size - used : 0;
+
+  // only separate home if there's space for it to be at least as large as root
+  if (separate_home && remaining >= 2 * DefaultRootSize)
+  {
+    plan.parts.emplace_back(Part{.role = PartitionRole::Root, .size = DefaultRootSize});
+    plan.parts.emplace_back(Part{.role = PartitionRole::Home, .size = 0});
+  }
+  else
+    plan.parts.emplace_back(Part{.role = PartitionRole::Root, .size = 0});
+
+  return plan;
+}
+
+
+bool PartitionPlan::is_valid(const uint64_t disk_size) const
+{
+  if (dev.empty() || parts.empty())
+    return false;
+
+  uint64_t total{0};
+
+  for (std::size_t i = 0 ; i < parts.size() ; ++i)
+  {
+    // only the last can be 0 (remaining)
+    if (parts[i].size == 0 && i != parts.size() - 1)
+      return false;
+    
+    total += parts[i].size;
+  }
+
+  const bool have_root = std::any_of(parts.cbegin(), parts.cend(), [](const Part& p){ return p.role == PartitionRole::Root; });
+  const bool have_efi = std::any_of(parts.cbegin(), parts.cend(), [](const Part& p){ return p.role == PartitionRole::Efi; });
+  
+  // remaining space must be usable for root
+  const uint64_t remaining = disk_size > total ? disk_size - total : 0;
+  const bool remaining_ok = parts.back().size != 0 || parts.back().role != PartitionRole::Root || remaining >= MinRootSize;
+
+  return have_root && have_efi && total < disk_size && remaining_ok;
+}
+
+
+// Partitioner
+bool Partitioner::create(const PartitionPlan& plan)
+{
+  qInfo() << "Creating " << plan.parts.size() << " partitions on " << plan.dev;
+
+  FdiskDevice device{plan.dev};
+
+  if (!device.valid())
+    return false;
+
+  auto cxt = device.cxt;
+
+  const uint64_t sector_size = fdisk_get_sector_size(cxt);
+  const uint64_t disk_size = fdisk_get_nsectors(cxt) * sector_size;
+
+  if (!plan.is_valid(disk_size))
+  {
+    qCritical() << "Partition plan is not valid for " << plan.dev;
+    return false;
+  }
+
+  if (const int r = fdisk_create_disklabel(cxt, "gpt"); r != 0)
+  {
+    qCritical() << "fdisk: failed to create GPT label: " << strerror(-r);
+    return false;
+  }
+
+  // align to optimal I/O size, but never less than 1MiB (which is the default grain)
+  const uint64_t grain = std::max<uint64_t>(PartitionPlan::MiB, fdisk_get_optimal_iosize(cxt));
+  fdisk_save_user_grain(cxt, grain);
+  fdisk_reset_alignment(cxt);
+
+  const uint64_t grain_sectors = fdisk_get_grain_size(cxt) / sector_size;
+
+  qInfo() << "Alignment: " << fdisk_get_grain_size(cxt) << " bytes";
+
+  const auto gpt = fdisk_get_label(cxt, nullptr);
+
+  for (const auto& part : plan.parts)
+  {
+    auto pa = fdisk_new_partition();
+    auto type = fdisk_label_get_parttype_from_string(gpt, role_guid(part.role));
+
+    fdisk_partition_set_type(pa, type);
+    fdisk_partition_set_name(pa, role_name(part.role));
+    fdisk_partition_start_follow_default(pa, 1);
+    fdisk_partition_partno_follow_default(pa, 1);
+
+    if (part.size == 0)
+      fdisk_partition_end_follow_default(pa, 1);
+    else
+    {
+      // round down to grain, so the next partition's start is aligned without a gap
+      const fdisk_sector_t sectors = std::max<uint64_t>(1, (part.size / sector_size) / grain_sectors) * grain_sectors;
+      fdisk_partition_set_size(pa, sectors);
+    }
+
+    size_t part_num{0};
+    const int r = fdisk_add_partition(cxt, pa, &part_num);
+    
+    fdisk_unref_parttype(type);
+    fdisk_unref_partition(pa);
+
+    if (r != 0)
+    {
+      qCritical() << "fdisk: failed to add " << role_name(part.role) << " partition: " << strerror(-r);
+      return false;  // nothing has been written
+    }
+    
+    qInfo() << "Added " << role_name(part.role) << " as partition " << part_num + 1;
+  }
+
+  if (const int r = fdisk_write_disklabel(cxt); r != 0)
+  {
+    qCritical() << "fdisk: failed to write partition table: " << strerror(-r);
+    return false;
+  }
+
+  // inform the kernel, otherwise /dev/<partitions> won't exist until reboot
+  if (const int r = fdisk_reread_partition_table(cxt); r != 0)
+    qWarning() << "fdisk: failed to reread partition table: " << strerror(-r);
+
+  return true;
+}
+
+
+bool Partitioner::set_type(const std::string_view disk, const int part_num, const std::string_view type_guid)
+{
+  if (part_num < 1)
+    return false;
+
+  FdiskDevice device{disk};
+
+  if (!device.valid())
+    return false;
+
+  auto cxt = device.cxt;
+
+  if (!fdisk_is_labeltype(cxt, FDISK_DISKLABEL_GPT))
+  {
+    qCritical() << disk << " is not GPT";
+    return false;
+  }
+  
+  auto type = fdisk_label_get_parttype_from_string(fdisk_get_label(cxt, nullptr), std::string{type_guid}.c_str());
+  
+  bool ok = type && fdisk_set_partition_type(cxt, part_num - 1, type) == 0 && fdisk_write_disklabel(cxt) == 0;
+
+  fdisk_unref_parttype(type);
+
+  if (!ok)
+    qCritical() << "fdisk: failed to set type of partition " << part_num << " on " << disk;
+
+  return ok;
+}
+
+
+const char * Partitioner::role_guid(const PartitionRole role)
+{
+  switch (role)
+  {
+    using enum PartitionRole;
+    case Efi:   return EfiType::guid;
+    case Root:  return LinuxRootType::guid;
+    case Home:  return LinuxHomeType::guid;
+    case Swap:  return LinuxSwapType::guid;
+  }
+  return LinuxRootType::guid;
+}
+
+
+const char * Partitioner::role_name(const PartitionRole role)
+{
+  switch (role)
+  {
+    using enum PartitionRole;
+    case Efi:   return EfiType::name;
+    case Root:  return LinuxRootType::name;
+    case Home:  return LinuxHomeType::name;
+    case Swap:  return LinuxSwapType::name;
+  }
+  return LinuxRootType::name;
+}
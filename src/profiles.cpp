@@ -7,6 +7,7 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include "profiles_data.hpp" // generated by profiles/compile_profiles.py
 
 
 std::map<QString, Profile> Profiles::m_tty_profiles;
@@ -14,20 +15,77 @@ std::map<QString, Profile> Profiles::m_desktop_profiles;
 std::map<QString, Profile> Profiles::m_greeters;
 
 
-static const fs::path ProfilesPath = "profiles";
-static const fs::path DesktopProfilesDir = ProfilesPath / "desktop";
-static const fs::path TtyProfilesDir = ProfilesPath / "tty";
-static const fs::path GreetersProfilesPath = ProfilesPath / "greeters.json";
+// profiles are compiled in, these are only read if OverridePath exists
+static const fs::path DesktopProfilesDir = "desktop";
+static const fs::path TtyProfilesDir = "tty";
+static const fs::path GreetersProfilesPath = "greeters.json";
 
 bool Profiles::read()
 {
-  const fs::path base_dir = fs::current_path();
+  m_desktop_profiles.clear();
+  m_tty_profiles.clear();
+  m_greeters.clear();
 
-  qInfo() << "Profiles location: " << (base_dir / ProfilesPath).string();
+  if (std::error_code ec; !fs::is_directory(OverridePath, ec))
+  {
+    read_embedded();
+    return true;
+  }
+
+  qInfo() << "Profiles override location: " << OverridePath.string();
   
-  return read_profiles(base_dir / DesktopProfilesDir, m_desktop_profiles) &&
-         read_profiles(base_dir / TtyProfilesDir, m_tty_profiles) && 
-         read_greeters(base_dir / GreetersProfilesPath);
+  return read_profiles(OverridePath / DesktopProfilesDir, m_desktop_profiles) &&
+         read_profiles(OverridePath / TtyProfilesDir, m_tty_profiles) && 
+         read_greeters(OverridePath / GreetersProfilesPath);
+}
+
+
+void Profiles::read_embedded()
+{
+  auto to_stringlist = [](const std::span<const std::string_view> values)
+  {
+    QStringList list;
+    list.reserve(values.size());
+
+    for (const auto v : values)
+      list.append(QString::fromUtf8(v.data(), v.size()));
+    return list;
+  };
+
+  auto to_string = [](const std::string_view s)
+  {
+    return QString::fromUtf8(s.data(), s.size());
+  };
+
+  auto add = [&to_stringlist, &to_string](const std::span<const profiles_data::ProfileEntry> entries, ProfilesMap& profiles)
+  {
+    for (const auto& entry : entries)
+    {
+      Profile profile { .name = to_string(entry.name),
+                        .packages = to_stringlist(entry.packages),
+                        .system_commands = to_stringlist(entry.system_commands),
+                        .user_commands = to_stringlist(entry.user_commands),
+                        .info = to_string(entry.info),
+                        .is_tty = entry.is_tty};
+
+      for (const auto& group : entry.command_groups)
+      {
+        profile.command_groups.emplace_back(CommandGroup{ .name = to_string(group.name),
+                                                          .commands = to_stringlist(group.commands),
+                                                          .after = to_stringlist(group.after),
+                                                          .user = group.user,
+                                                          .parallel = group.parallel});
+      }
+
+      profiles.emplace(profile.name, std::move(profile));
+    }
+  };
+
+  add(profiles_data::Desktop, m_desktop_profiles);
+  add(profiles_data::Tty, m_tty_profiles);
+  add(profiles_data::Greeters, m_greeters);
+
+  qInfo() << "Profiles: " << m_desktop_profiles.size() << " desktop, " << m_tty_profiles.size() << " tty, " << m_greeters.size() << " greeters";
 }
 
 
@@ -67,6 +125,7 @@ bool Profiles::read_profile (const fs::path path, const QJsonDocument& doc, Prof
   auto is_valid = validate(root, "packages", QJsonValue::Array) &&
                   validate(root, "system_commands", QJsonValue::Array) &&
                   validate(root, "user_commands", QJsonValue::Array) &&
+                  validate(root, "command_groups", QJsonValue::Array, false) &&
                   validate(root, "name", QJsonValue::String);
 
   if (!is_valid)
@@ -80,6 +139,9 @@ bool Profiles::read_profile (const fs::path path, const QJsonDocument& doc, Prof
              to_stringlist(root["system_commands"].toArray(), profile.system_commands) &&
              to_stringlist(root["user_commands"].toArray(), profile.user_commands);
 
+  if (is_valid && root.contains("command_groups"))
+    is_valid = read_command_groups(root["command_groups"].toArray(), profile.command_groups);
+
   if (is_valid)
     profiles.emplace(root["name"].toString(), std::move(profile));
 
@@ -143,6 +205,41 @@ bool Profiles::read_greeters (const fs::path& path)
 }
 
 
+bool Profiles::read_command_groups (const QJsonArray& arr, std::vector<CommandGroup>& groups)
+{
+  // the build validates dependencies of compiled profiles, the runner checks these
+  for (const auto& entry : arr)
+  {
+    if (!entry.isObject())
+      return false;
+    
+    const auto& obj = entry.toObject();
+
+    if (!(validate(obj, "name", QJsonValue::String) &&
+          validate(obj, "commands", QJsonValue::Array) &&
+          validate(obj, "after", QJsonValue::Array, false) &&
+          validate(obj, "user", QJsonValue::Bool, false) &&
+          validate(obj, "parallel", QJsonValue::Bool, false)))
+    {
+      return false;
+    }
+    
+    CommandGroup group {.name = obj["name"].toString(),
+                        .user = obj["user"].toBool(),
+                        .parallel = obj["parallel"].toBool()};
+
+    if (!to_stringlist(obj["commands"].toArray(), group.commands) ||
+        !to_stringlist(obj["after"].toArray(), group.after))
+    {
+      return false;
+    }
+
+    groups.push_back(std::move(group));
+  }
+  return true;
+}
+
+
 bool Profiles::validate(const QJsonObject& root, const QString& key, const QJsonValue::Type t, const bool required)
 {
   if (required)
@@ -0,0 +1,148 @@
+#include <ali/shadow.hpp>
+#include <ali/file_utils.hpp>
+#include <crypt.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <QDebug>
+
+
+// yescrypt prefix, and 0 means the library's default cost
+static const char YescryptPrefix[] = "$y$";
+static const unsigned long DefaultCost = 0;
+
+
+// crypt_data is large and holds the hash, so on the heap and cleared after use
+struct CryptData
+{
+  CryptData() : data(std::make_unique<crypt_data>())
+  {
+    std::memset(data.get(), 0, sizeof(crypt_data));
+  }
+
+  ~CryptData()
+  {
+    explicit_bzero(data.get(), sizeof(crypt_data));
+  }
+
+  std::unique_ptr<crypt_data> data;
+};
+
+
+// field 'n' (from 0) of a colon separated line
+static std::string_view get_field(const std::string_view line, const std::size_t n)
+{
+  std::size_t start{0};
+
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    if (start = line.find(':', start); start == std::string_view::npos)
+      return {};
+    ++start;
+  }
+
+  return line.substr(start, line.find(':', start) - start);
+}
+
+
+static std::vector<std::string> read_lines(const fs::path& path)
+{
+  std::vector<std::string> lines;
+
+  if (std::ifstream stream{path}; stream.good())
+  {
+    for (std::string line; std::getline(stream, line); )
+      lines.push_back(std::move(line));
+  }
+
+  return lines;
+}
+
+
+std::string Shadow::hash(const std::string_view password)
+{
+  char salt[CRYPT_GENSALT_OUTPUT_SIZE];
+
+  // null random bytes: libcrypt gets them from the OS
+  if (!crypt_gensalt_rn(YescryptPrefix, DefaultCost, nullptr, 0, salt, sizeof(salt)))
+  {
+    qCritical() << "crypt_gensalt failed: " << strerror(errno);
+    return {};
+  }
+
+  CryptData cd;
+  const std::string pass{password};
+
+  // failure returns a string starting with '*'
+  if (const char * hashed = crypt_r(pass.c_str(), salt, cd.data.get()); !hashed || hashed[0] == '*')
+  {
+    qCritical() << "crypt failed: " << strerror(errno);
+    return {};
+  }
+  else
+    return hashed;
+}
+
+
+bool Shadow::verify(const std::string_view password, const std::string_view hash)
+{
+  CryptData cd;
+  const std::string pass{password}, setting{hash};
+
+  const char * hashed = crypt_r(pass.c_str(), setting.c_str(), cd.data.get());
+  return hashed && hashed[0] != '*' && hash == hashed;
+}
+
+
+bool Shadow::set_password(const fs::path& path, const std::string_view user, const std::string_view password)
+{
+  const auto hashed = hash(password);
+
+  if (hashed.empty())
+    return false;
+
+  auto lines = read_lines(path);
+  const std::string prefix = std::format("{}:", user);
+  
+  const auto it = std::find_if(lines.begin(), lines.end(), [&prefix](const std::string& line){ return line.starts_with(prefix); });
+  
+  if (it == lines.end())
+  {
+    qCritical() << "User " << user << " not in " << path.string();
+    return false;
+  }
+
+  // name:password:lastchg:min:max:warn:inactive:expire:reserved
+  std::vector<std::string> fields;
+  std::istringstream line{*it};
+  for (std::string field; std::getline(line, field, ':'); )
+    fields.push_back(std::move(field));
+  
+  fields.resize(std::max<std::size_t>(fields.size(), 9));
+  
+  // lastchg is days since epoch
+  fields[1] = hashed;
+  fields[2] = std::to_string(std::chrono::duration_cast<std::chrono::days>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+  std::string updated;
+  for (std::size_t i = 0 ; i < fields.size() ; ++i)
+    updated += (i ? ":" : "") + fields[i];
+
+  *it = std::move(updated);
+
+  std::stringstream content;
+  for (const auto& line : lines)
+    content << line << '\n';
+  
+  if (!FileUtils::write_atomic(path, content.str(), fs::perms::owner_read | fs::perms::owner_write))
+    return false;
+
+  // verify what was written
+  const auto written = read_lines(path);
+  const auto written_it = std::find_if(written.cbegin(), written.cend(), [&prefix](const std::string& line){ return line.starts_with(prefix); });
+
+  return written_it != written.cend() && verify(password, get_field(*written_it, 1));
+}
@@ -0,0 +1,81 @@
+#include <ali/shared_install.hpp>
+#include <ali/commands.hpp>
+#include <sstream>
+#include <QDebug>
+
+
+SharedInstall::SharedInstall(const std::size_t n_targets) : m_targets(n_targets)
+{
+
+}
+
+
+fs::path SharedInstall::arrive(const InstallTarget& target, const bool mounted, const Step& step)
+{
+  std::unique_lock lock{m_mutex};
+
+  if (mounted && m_cache.empty())
+    m_cache = target.path(CachePath);
+
+  // the last to arrive may have failed, without a step. A target that arrived waits,
+  // so its step can be run by another thread
+  if (mounted && step && !m_step)
+    m_step = step;
+
+  if (++m_arrived < m_targets)
+    m_cv.wait(lock, [this]{ return m_done; });
+  else
+  {
+    // the last to arrive runs the step, the others are waiting
+    try
+    {
+      if (!m_cache.empty())
+      {
+        std::error_code ec;
+        fs::create_directories(m_cache, ec);
+
+        if (!m_step)
+        {
+          qWarning() << "Shared install has no step, targets download their packages";
+          m_cache.clear();
+        }
+        else if (ec || !m_step(m_cache))
+          m_cache.clear();
+      }
+    }
+    catch (const std::exception& e)
+    {
+      qCritical() << "Shared install step: " << e.what();
+      m_cache.clear();
+    }
+
+    m_done = true;
+    m_cv.notify_all();
+  }
+
+  return m_cache;
+}
+
+
+bool SharedInstall::download(const std::vector<std::string>& packages, const fs::path& cache, const Log& log)
+{
+  std::error_code ec;
+  fs::create_directories(DbPath, ec);
+
+  std::stringstream cmd_string;
+  cmd_string << "pacman -Syw --noconfirm --dbpath " << DbPath.string() << " --cachedir " << cache.string();
+
+  for (const auto& name : packages)
+    cmd_string << ' ' << name;
+
+  qInfo() << cmd_string.str();
+
+  Command cmd{cmd_string.str(), [&log](const std::string_view out)
+  {
+    log(out);
+  }};
+
+  cmd.set_limits(std::chrono::seconds{0}, PacmanStallLimit);
+
+  return cmd.execute() == CmdSuccess;
+}
@@ -0,0 +1,145 @@
+#include <ali/stage_journal.hpp>
+#include <ali/file_utils.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <QDebug>
+
+
+// Format, a line each:
+//  input <key> <value>
+//  stage <digest> <name>
+// Keys and digests have no spaces, values and stage names may.
+
+
+bool StageJournal::begin(const fs::path& root, const Inputs& inputs)
+{
+  m_path = root / Path;
+  m_inputs = inputs;
+  m_stages.clear();
+
+  std::error_code ec;
+  if (fs::create_directories(m_path.parent_path(), ec); ec)
+  {
+    qCritical() << "Failed to create " << m_path.parent_path().string() << ": " << ec.message();
+    close();
+    return false;
+  }
+
+  if (!write())
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+
+bool StageJournal::load(const fs::path& root)
+{
+  close();
+
+  const fs::path path {root / Path};
+  std::ifstream stream{path};
+
+  if (!stream.good())
+    return false;
+
+  for (std::string line; std::getline(stream, line); )
+  {
+    if (line.empty() || line.starts_with('#'))
+      continue;
+
+    std::istringstream fields{line};
+    std::string type, key, value;
+
+    fields >> type >> key;
+    fields >> std::ws;
+    std::getline(fields, value);
+
+    if (key.empty() || (type == "stage" && value.empty()))
+    {
+      qWarning() << "Invalid journal line: " << line;
+      m_inputs.clear();
+      m_stages.clear();
+      return false;
+    }
+    else if (type == "input")
+      m_inputs[key] = value;
+    else if (type == "stage")
+      m_stages.push_back(Stage{.name = value, .digest = key});
+  }
+
+  m_path = path;
+  return true;
+}
+
+
+void StageJournal::close()
+{
+  m_path.clear();
+  m_inputs.clear();
+  m_stages.clear();
+}
+
+
+bool StageJournal::complete(const std::string_view stage, const std::string_view inputs)
+{
+  if (!is_open())
+    return false;
+
+  invalidate(stage);
+  m_stages.push_back(Stage{.name = std::string{stage}, .digest = digest(inputs)});
+  return write();
+}
+
+
+bool StageJournal::is_complete(const std::string_view stage) const
+{
+  return std::any_of(m_stages.cbegin(), m_stages.cend(), [stage](const Stage& s){ return s.name == stage; });
+}
+
+
+bool StageJournal::invalidate(const std::string_view stage)
+{
+  const auto it = std::find_if(m_stages.begin(), m_stages.end(), [stage](const Stage& s){ return s.name == stage; });
+
+  if (it == m_stages.end())
+    return true;
+
+  m_stages.erase(it, m_stages.end());
+  return write();
+}
+
+
+std::string StageJournal::input(const std::string_view key) const
+{
+  const auto it = m_inputs.find(key);
+  return it == m_inputs.end() ? std::string{} : it->second;
+}
+
+
+// only compared with a digest from the same binary, on resume
+std::string StageJournal::digest(const std::string_view inputs)
+{
+  return std::format("{:016x}", std::hash<std::string_view>{}(inputs));
+}
+
+
+bool StageJournal::write()
+{
+  if (!is_open())
+    return false;
+
+  std::stringstream content;
+  content << "# ali install journal\n";
+
+  for (const auto& [key, value] : m_inputs)
+    content << "input " << key << ' ' << value << '\n';
+
+  for (const auto& stage : m_stages)
+    content << "stage " << stage.digest << ' ' << stage.name << '\n';
+
+  return FileUtils::write_atomic(m_path, content.str());
+}
@@ -0,0 +1,309 @@
+#include <ali/sync_db.hpp>
+#include <ali/commands.hpp>
+#include <archive.h>
+#include <archive_entry.h>
+#include <mutex>
+#include <charconv>
+#include <algorithm>
+#include <QDebug>
+
+
+// pacman.conf order, so the first repo wins for duplicate names
+static const std::vector<std::string_view> Repos = {"core", "extra", "multilib"};
+
+
+std::shared_future<bool> SyncDb::m_loaded;
+std::deque<std::string> SyncDb::m_string_store;
+std::vector<std::string_view> SyncDb::m_strings;
+std::unordered_map<std::string_view, StrId, SyncDb::Hash, std::equal_to<>> SyncDb::m_string_ids;
+std::vector<SyncPackage> SyncDb::m_packages;
+std::vector<StrId> SyncDb::m_ids;
+std::unordered_map<StrId, uint32_t, SyncDb::Hash> SyncDb::m_by_name;
+std::unordered_multimap<StrId, uint32_t, SyncDb::Hash> SyncDb::m_by_provides;
+std::unordered_multimap<StrId, uint32_t, SyncDb::Hash> SyncDb::m_by_group;
+
+
+void SyncDb::load_async()
+{
+  static std::once_flag once;
+  std::call_once(once, []
+  {
+    m_loaded = std::async(std::launch::async, &SyncDb::load).share();
+  });
+}
+
+
+bool SyncDb::wait()
+{
+  load_async();
+  return m_loaded.get();
+}
+
+
+const SyncPackage * SyncDb::find(const std::string_view name)
+{
+  if (!wait())
+    return nullptr;
+  
+  if (const auto id = m_string_ids.find(name); id != m_string_ids.cend())
+  {
+    if (const auto it = m_by_name.find(id->second); it != m_by_name.cend())
+      return &m_packages[it->second];
+  }
+  return nullptr;
+}
+
+
+const SyncPackage * SyncDb::find_provider(const std::string_view name)
+{
+  if (const auto pkg = find(name); pkg)
+    return pkg;
+
+  if (const auto id = m_string_ids.find(name); id != m_string_ids.cend())
+  {
+    if (const auto it = m_by_provides.find(id->second); it != m_by_provides.cend())
+      return &m_packages[it->second];
+  }
+  return nullptr;
+}
+
+
+std::vector<const SyncPackage *> SyncDb::group(const std::string_view name)
+{
+  std::vector<const SyncPackage *> packages;
+
+  if (!wait())
+    return packages;
+
+  if (const auto id = m_string_ids.find(name); id != m_string_ids.cend())
+  {
+    const auto [begin, end] = m_by_group.equal_range(id->second);
+    for (auto it = begin ; it != end ; ++it)
+      packages.push_back(&m_packages[it->second]);
+  }
+
+  return packages;
+}
+
+
+bool SyncDb::load()
+{
+  std::vector<std::pair<fs::path, std::string>> dbs;
+
+  auto find_dbs = [&dbs]
+  {
+    dbs.clear();
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator{SyncDir, ec})
+    {
+      if (entry.is_regular_file() && entry.path().extension() == ".db")
+        dbs.emplace_back(entry.path(), entry.path().stem().string());
+    }
+
+    std::sort(dbs.begin(), dbs.end(), [](const auto& a, const auto& b)
+    {
+      const auto pos_a = std::find(Repos.cbegin(), Repos.cend(), a.second);
+      const auto pos_b = std::find(Repos.cbegin(), Repos.cend(), b.second);
+      return pos_a != pos_b ? pos_a < pos_b : a.second < b.second;
+    });
+  };
+
+  find_dbs();
+
+  #ifdef ALI_PROD
+  if (dbs.empty())
+  {
+    qInfo() << "Sync databases not found, syncing";
+
+    if (PacmanSyncDb cmd; cmd.execute() == CmdSuccess)
+      find_dbs();
+  }
+  #endif
+
+  if (dbs.empty())
+  {
+    qWarning() << "Sync databases not found in " << SyncDir.string();
+    return false;
+  }
+
+  intern(""); // id 0 is empty string, for missing fields
+
+  bool read_any{false};
+
+  for (const auto& [path, repo] : dbs)
+    read_any |= read_db(path, repo);
+
+  qInfo() << "Sync databases: " << m_packages.size() << " packages, " << m_strings.size() << " strings";
+
+  return read_any && !m_packages.empty();
+}
+
+
+bool SyncDb::read_db(const fs::path& path, const std::string_view repo)
+{
+  // the db is a compressed tar, with a directory per package: "<name>-<pkgver>-<pkgrel>/",
+  // containing "desc" (and "depends" for older db versions)
+  auto archive = archive_read_new();
+  archive_read_support_filter_all(archive);
+  archive_read_support_format_tar(archive);
+
+  if (archive_read_open_filename(archive, path.c_str(), 64 * 1024) != ARCHIVE_OK)
+  {
+    qCritical() << "Failed to open " << path.string() << ": " << archive_error_string(archive);
+    archive_read_free(archive);
+    return false;
+  }
+
+  const StrId repo_id = intern(repo);
+  const std::size_t count_before = m_packages.size();
+
+  archive_entry * entry{nullptr};
+  std::string content, current_dir;
+  SyncPackage pkg;
+  int r{ARCHIVE_OK};
+
+  auto add_package = [&pkg]()
+  {
+    // keep first if duplicate name across repos
+    if (pkg.name && !m_by_name.contains(pkg.name))
+    {
+      const auto index = static_cast<uint32_t>(m_packages.size());
+
+      m_by_name.emplace(pkg.name, index);
+
+      for (const auto id : ids(pkg.provides))
+        m_by_provides.emplace(id, index);
+      
+      for (const auto id : ids(pkg.groups))
+        m_by_group.emplace(id, index);
+
+      m_packages.push_back(pkg);
+    }
+  };
+
+  while ((r = archive_read_next_header(archive, &entry)) == ARCHIVE_OK)
+  {
+    const std::string_view pathname{archive_entry_pathname(entry)};
+    const auto slash = pathname.rfind('/');
+    
+    if (slash == std::string_view::npos || archive_entry_filetype(entry) != AE_IFREG)
+    {
+      archive_read_data_skip(archive);
+      continue;
+    }
+    
+    // entries for a package are consecutive
+    if (const auto dir = pathname.substr(0, slash); dir != current_dir)
+    {
+      add_package();
+      pkg = SyncPackage{.repo = repo_id};
+      current_dir = dir;
+    }
+
+    if (const auto file = pathname.substr(slash+1); file == "desc" || file == "depends")
+    {
+      content.resize(archive_entry_size(entry));
+      
+      if (const auto n = archive_read_data(archive, content.data(), content.size()); n >= 0)
+      {
+        content.resize(n);
+        parse_desc(content, pkg);
+      }
+    }
+    else
+      archive_read_data_skip(archive);
+  }
+
+  add_package();
+
+  if (r != ARCHIVE_EOF)
+    qWarning() << "Error reading " << path.string() << ": " << archive_error_string(archive);
+  
+  qInfo() << "Read " << m_packages.size() - count_before << " packages from " << repo;
+
+  archive_read_free(archive);
+  return r == ARCHIVE_EOF;
+}
+
+
+void SyncDb::parse_desc(const std::string_view content, SyncPackage& pkg)
+{
+  // "%FIELD%\nvalue\nvalue\n\n%FIELD%\n..."
+  SyncPackage::Ids * list{nullptr};
+  std::string_view field;
+  
+  auto to_u64 = [](const std::string_view s)
+  {
+    uint64_t value{0};
+    std::from_chars(s.data(), s.data() + s.size(), value);
+    return value;
+  };
+
+  for (std::size_t pos = 0 ; pos < content.size() ; )
+  {
+    auto end = content.find('\n', pos);
+    if (end == std::string_view::npos)
+      end = content.size();
+
+    const auto line = content.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (line.empty())
+    {
+      field = {};
+      list = nullptr;
+    }
+    else if (line.size() > 2 && line.front() == '%' && line.back() == '%')
+    {
+      field = line;
+
+      if (field == "%DEPENDS%")
+        list = &pkg.depends;
+      else if (field == "%PROVIDES%")
+        list = &pkg.provides;
+      else if (field == "%GROUPS%")
+        list = &pkg.groups;
+      else
+        list = nullptr;
+
+      // a list's ids must be contiguous in m_ids
+      if (list)
+        *list = SyncPackage::Ids{.begin = static_cast<uint32_t>(m_ids.size()), .count = 0};
+    }
+    else if (list)
+    {
+      m_ids.push_back(intern(list == &pkg.groups ? line : strip_constraint(line)));
+      ++list->count;
+    }
+    else if (field == "%NAME%")
+      pkg.name = intern(line);
+    else if (field == "%VERSION%")
+      pkg.version = intern(line);
+    else if (field == "%CSIZE%")
+      pkg.download_size = to_u64(line);
+    else if (field == "%ISIZE%")
+      pkg.installed_size = to_u64(line);
+  }
+}
+
+
+StrId SyncDb::intern(const std::string_view s)
+{
+  if (const auto it = m_string_ids.find(s); it != m_string_ids.cend())
+    return it->second;
+  
+  const auto id = static_cast<StrId>(m_strings.size());
+  const std::string_view stored = m_string_store.emplace_back(s);
+  
+  m_strings.push_back(stored);
+  m_string_ids.emplace(stored, id);
+  return id;
+}
+
+
+std::string_view SyncDb::strip_constraint(const std::string_view s)
+{
+  // "glibc>=2.38", "sh=5.2", "libfoo.so=1-64"
+  return s.substr(0, s.find_first_of("<>="));
+}
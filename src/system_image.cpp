@@ -0,0 +1,382 @@
+#include <ali/system_image.hpp>
+#include <ali/commands.hpp>
+#include <ali/file_utils.hpp>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <QDebug>
+
+
+// not captured: machine specific, or regenerated on first boot
+static const std::vector<std::string_view> Excludes =
+{
+  "etc/hostname",
+  "etc/fstab",
+  "etc/machine-id",
+  "etc/pacman.d/gnupg",  // the keyring's private signing key
+  "etc/ssh/ssh_host_*",
+  "var/lib/systemd/random-seed",
+  "var/cache/pacman/pkg/*",
+  "var/log/*",
+  "var/tmp/*",
+  "var/lib/ali",  // install journal
+  "lost+found"
+};
+
+// directories created without their content
+static const std::vector<std::string_view> EmptyDirs = {"dev", "proc", "sys", "run", "tmp", "mnt", "efi"};
+
+// keeps ownership, ACLs and xattrs (including security.capability)
+static constexpr std::string_view TarOptions = "--acls --xattrs --xattrs-include='*' --numeric-owner";
+
+
+static std::string quote(const std::string_view s)
+{
+  return std::format("'{}'", s);
+}
+
+
+SystemImage::SystemImage(Log&& info, Log&& warning) : m_info(std::move(info)), m_warning(std::move(warning))
+{
+
+}
+
+
+std::vector<ImageChunk> SystemImage::plan(const fs::path& root)
+{
+  std::vector<ImageChunk> chunks;
+  ImageChunk loose {.file = "root.tar.zst"};
+
+  auto add_dir = [&chunks](const std::string& path)
+  {
+    std::string file {path};
+    std::replace(file.begin(), file.end(), '/', '_');
+    chunks.push_back(ImageChunk{.file = file + ".tar.zst", .paths = {path}});
+  };
+
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator{root, ec})
+  {
+    const std::string name = entry.path().filename().string();
+
+    if (std::find(EmptyDirs.begin(), EmptyDirs.end(), name) != EmptyDirs.end())
+      loose.empty_dirs.push_back(name);
+    else if (name == "lost+found")
+      continue;
+    else if (!entry.is_directory() || entry.is_symlink())
+      loose.paths.push_back(name);  // i.e. /bin -> usr/bin
+    else if (name == "usr")
+    {
+      // /usr is most of the system, split so it extracts concurrently
+      loose.empty_dirs.push_back(name);
+
+      for (const auto& usr_entry : fs::directory_iterator{entry.path(), ec})
+      {
+        const std::string usr_path = "usr/" + usr_entry.path().filename().string();
+
+        if (usr_entry.is_directory() && !usr_entry.is_symlink())
+          add_dir(usr_path);
+        else
+          loose.paths.push_back(usr_path);
+      }
+    }
+    else
+      add_dir(name);
+  }
+
+  if (ec)
+    m_warning(std::format("Error reading {}: {}", root.string(), ec.message()));
+
+  chunks.push_back(std::move(loose));
+  return chunks;
+}
+
+
+bool SystemImage::capture(const fs::path& root, const fs::path& image_dir, const fs::path& btrfs_top_level, const std::string_view subvolume)
+{
+  std::error_code ec;
+  if (fs::create_directories(image_dir, ec); ec)
+  {
+    m_warning(std::format("Failed to create {}: {}", image_dir.string(), ec.message()));
+    return false;
+  }
+
+  auto chunks = plan(root);
+
+  std::stringstream excludes;
+  for (const auto pattern : Excludes)
+    excludes << " --exclude=" << quote(pattern);
+
+  std::vector<std::string> cmds;
+  for (const auto& chunk : chunks)
+  {
+    // --no-recursion and --recursion are positional
+    std::stringstream cmd;
+    cmd << "tar --create --sparse " << TarOptions << " --anchored" << excludes.str();
+    cmd << " --use-compress-program=" << quote(std::format("zstd -T0 -{}", CompressionLevel));
+    cmd << " --file=" << quote((image_dir / chunk.file).string());
+    cmd << " -C " << quote(root.string());
+
+    if (!chunk.empty_dirs.empty())
+    {
+      cmd << " --no-recursion";
+      for (const auto& dir : chunk.empty_dirs)
+        cmd << ' ' << quote(dir);
+      cmd << " --recursion";
+    }
+
+    for (const auto& path : chunk.paths)
+      cmd << ' ' << quote(path);
+
+    cmds.push_back(cmd.str());
+  }
+
+  m_info(std::format("Capturing {} to {} in {} chunks", root.string(), image_dir.string(), chunks.size()));
+
+  if (!run_all(cmds))
+    return false;
+
+  // the tar chunks are still required to deploy to a non-btrfs root, and for /home
+  if (!btrfs_top_level.empty())
+  {
+    if (!send(btrfs_top_level, subvolume, image_dir))
+      return false;
+    
+    chunks.push_back(ImageChunk{.file = std::string{SendStreamName}, .send_stream = true});
+  }
+
+  uint64_t image_size{0};
+  for (const auto& chunk : chunks)
+    image_size += fs::file_size(image_dir / chunk.file, ec);
+
+  m_info(std::format("Image size: {}", format_size(image_size)));
+
+  // written last, so an interrupted capture is not an image
+  return write_manifest(image_dir, chunks);
+}
+
+
+bool SystemImage::deploy(const fs::path& image_dir, const fs::path& root, const bool root_received)
+{
+  const auto chunks = read_manifest(image_dir);
+
+  if (chunks.empty())
+  {
+    m_warning(std::format("{} is not an image", image_dir.string()));
+    return false;
+  }
+
+  std::vector<std::string> cmds;
+  for (const auto& chunk : chunks)
+  {
+    if (chunk.send_stream || (root_received && chunk.file != HomeChunk))
+      continue;
+
+    cmds.push_back(std::format("tar --extract --same-permissions --same-owner {} --use-compress-program='zstd -d' --file={} -C {}",
+                               TarOptions, quote((image_dir / chunk.file).string()), quote(root.string())));
+  }
+
+  m_info(std::format("Deploying {} chunks from {} to {}", cmds.size(), image_dir.string(), root.string()));
+
+  if (!cmds.empty() && !run_all(cmds))
+    return false;
+
+  // new machine-id, otherwise first boot runs systemd-firstboot
+  Command machine_id{std::format("systemd-machine-id-setup --root={}", quote(root.string()))};
+  if (machine_id.execute() != CmdSuccess)
+    m_warning("Failed to create machine-id, it is created on first boot");
+
+  // a new keyring, so each machine has its own signing key
+  if (ChRootCmd init{root, "pacman-key --init"}; init.execute() != CmdSuccess)
+    m_warning("Failed to initialise the pacman keyring");
+  else if (ChRootCmd populate{root, "pacman-key --populate"}; populate.execute() != CmdSuccess)
+    m_warning("Failed to populate the pacman keyring");
+
+  return true;
+}
+
+
+bool SystemImage::send(const fs::path& top_level, const std::string_view subvolume, const fs::path& image_dir)
+{
+  // send a cleaned, read-only snapshot. It's deleted after, the reference machine doesn't need it
+  const fs::path snapshot = top_level / BaseSubvolume;
+  const fs::path stream = image_dir / SendStreamName;
+
+  m_info(std::format("Sending subvolume {} to {}", subvolume, stream.string()));
+
+  if (fs::exists(snapshot))
+    DeleteBtrVolume{snapshot}.execute();
+
+  if (SnapshotBtrVolume cmd{top_level / subvolume, snapshot}; cmd.execute() != CmdSuccess)
+  {
+    m_warning(std::format("Failed to snapshot {}", subvolume));
+    return false;
+  }
+
+  remove_excluded(snapshot);
+
+  bool ok{false};
+
+  if (ReadOnlyBtrVolume cmd{snapshot}; cmd.execute() != CmdSuccess)
+    m_warning("Failed to set snapshot read-only");
+  else if (SendBtrVolume send{snapshot, stream}; send.execute() != CmdSuccess)
+    m_warning("btrfs send failed");
+  else
+    ok = true;
+
+  if (DeleteBtrVolume cmd{snapshot}; cmd.execute() != CmdSuccess)
+    m_warning(std::format("Failed to delete snapshot {}", snapshot.string()));
+
+  return ok;
+}
+
+
+bool SystemImage::receive(const fs::path& image_dir, const fs::path& top_level, const std::string_view subvolume)
+{
+  const fs::path stream = image_dir / SendStreamName;
+
+  m_info(std::format("Receiving {} to {}", stream.string(), top_level.string()));
+
+  if (ReceiveBtrVolume cmd{stream, top_level}; cmd.execute() != CmdSuccess)
+  {
+    m_warning("btrfs receive failed");
+    return false;
+  }
+
+  // the received subvolume is read-only, the root is a writable snapshot of it. The
+  // snapshot shares the received extents, so the received subvolume is then deleted
+  if (SnapshotBtrVolume cmd{top_level / BaseSubvolume, top_level / subvolume}; cmd.execute() != CmdSuccess)
+  {
+    m_warning(std::format("Failed to snapshot {} as {}", BaseSubvolume, subvolume));
+    return false;
+  }
+
+  if (DeleteBtrVolume cmd{top_level / BaseSubvolume}; cmd.execute() != CmdSuccess)
+    m_warning(std::format("Failed to delete subvolume {}", BaseSubvolume));
+
+  return true;
+}
+
+
+// same as Excludes for tar: "dir/*" removes the content, "dir/prefix*" removes matching entries
+void SystemImage::remove_excluded(const fs::path& root)
+{
+  std::error_code ec;
+
+  for (const std::string_view pattern : Excludes)
+  {
+    if (const auto star = pattern.find('*'); star == std::string_view::npos)
+      fs::remove_all(root / pattern, ec);
+    else
+    {
+      const fs::path path {root / pattern.substr(0, star)};
+      const fs::path dir = path.has_filename() ? path.parent_path() : path;
+      const std::string prefix = path.has_filename() ? path.filename().string() : std::string{};
+
+      for (const auto& entry : fs::directory_iterator{dir, ec})
+      {
+        if (entry.path().filename().string().starts_with(prefix))
+          fs::remove_all(entry.path(), ec);
+      }
+    }
+  }
+}
+
+
+bool SystemImage::run_all(const std::vector<std::string>& cmds)
+{
+  // chunks vary in size (usr/lib is much larger than most), so each thread
+  // takes the next chunk rather than running in batches
+  const std::size_t n_threads = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, cmds.size());
+
+  std::atomic_size_t next{0};
+  std::atomic_bool ok{true};
+
+  {
+    std::vector<std::jthread> threads;
+
+    for (std::size_t i = 0 ; i < n_threads ; ++i)
+    {
+      threads.emplace_back([this, &cmds, &next, &ok, stop = Command::get_stop_token()]
+      {
+        // cancelled with the caller
+        Command::set_stop_token(stop);
+
+        for (std::size_t c = next++ ; c < cmds.size() ; c = next++)
+        {
+          Command cmd{cmds[c], [this](const std::string_view out)
+          {
+            m_info(out);
+          }};
+
+          if (const int r = cmd.execute(); r != CmdSuccess)
+          {
+            m_warning(std::format("Failed with {}: {}", r, cmds[c]));
+            ok = false;
+          }
+        }
+      });
+    }
+  }
+
+  return ok;
+}
+
+
+bool SystemImage::write_manifest(const fs::path& image_dir, const std::vector<ImageChunk>& chunks)
+{
+  std::stringstream content;
+  content << "# ali image: one chunk per line\n";
+
+  for (const auto& chunk : chunks)
+    content << (chunk.send_stream ? "send " : "") << chunk.file << '\n';
+
+  return FileUtils::write_atomic(image_dir / ManifestName, content.str());
+}
+
+
+std::vector<ImageChunk> SystemImage::read_manifest(const fs::path& image_dir)
+{
+  std::vector<ImageChunk> chunks;
+
+  if (std::ifstream stream{image_dir / ManifestName}; stream.good())
+  {
+    for (std::string line; std::getline(stream, line); )
+    {
+      if (line.empty() || line.starts_with('#'))
+        continue;
+      
+      const bool send_stream = line.starts_with("send ");
+      if (send_stream)
+        line.erase(0, 5);
+
+      // chunk files are always in the image directory
+      if (line.find('/') != std::string::npos || !fs::exists(image_dir / line))
+      {
+        qWarning() << "Image chunk invalid or missing: " << line;
+        return {};
+      }
+
+      chunks.push_back(ImageChunk{.file = line, .send_stream = send_stream});
+    }
+  }
+
+  return chunks;
+}
+
+
+bool SystemImage::is_image(const fs::path& image_dir)
+{
+  SystemImage image{[](const std::string_view){}, [](const std::string_view){}};
+  return !image.read_manifest(image_dir).empty();
+}
+
+
+bool SystemImage::has_send_stream(const fs::path& image_dir)
+{
+  SystemImage image{[](const std::string_view){}, [](const std::string_view){}};
+  const auto chunks = image.read_manifest(image_dir);
+  return std::any_of(chunks.begin(), chunks.end(), [](const ImageChunk& chunk){ return chunk.send_stream; });
+}
@@ -0,0 +1,232 @@
+#include <ali/unit_enabler.hpp>
+#include <fstream>
+#include <sstream>
+#include <QDebug>
+
+
+// order of precedence, as systemctl
+static const std::vector<fs::path> UnitPaths = {"/etc/systemd/system", "/usr/lib/systemd/system"};
+static const fs::path ConfigPath {"/etc/systemd/system"};
+
+
+// "foo@bar.service" -> {"foo@.service", "bar"}, otherwise {name, ""}
+static std::pair<std::string, std::string> split_instance(const std::string_view name)
+{
+  const auto at = name.find('@');
+  const auto dot = name.rfind('.');
+
+  if (at == std::string_view::npos || dot == std::string_view::npos || dot < at)
+    return {std::string{name}, ""};
+
+  return {std::format("{}{}", name.substr(0, at+1), name.substr(dot)), std::string{name.substr(at + 1, dot - at - 1)}};
+}
+
+
+UnitEnabler::UnitEnabler(const fs::path& root) : m_root(root)
+{
+
+}
+
+
+bool UnitEnabler::enable(const std::vector<std::string>& units)
+{
+  bool ok = true;
+  for (const auto& unit : units)
+    ok &= enable(unit);
+  return ok;
+}
+
+
+bool UnitEnabler::enable(const std::string_view unit)
+{
+  if (m_enabled.contains(unit))
+    return true;
+
+  m_enabled.emplace(unit);
+
+  const auto [template_name, instance] = split_instance(unit);
+
+  // instance file may exist, otherwise use template
+  auto path = find_unit(unit);
+  if (path.empty() && !instance.empty())
+    path = find_unit(template_name);
+
+  if (path.empty())
+  {
+    qWarning() << "Unit not found: " << unit;
+    return false;
+  }
+
+  InstallSection section;
+  if (!read_install_section(m_root / path.relative_path(), section))
+    return false;
+
+  // enabling a template without an instance uses DefaultInstance
+  std::string name{unit};
+  std::string name_instance{instance};
+
+  if (const bool is_template = unit.find("@.") != std::string_view::npos; is_template && !section.default_instance.empty())
+  {
+    name_instance = section.default_instance;
+    name = std::format("{}{}{}", unit.substr(0, unit.find('@')+1), name_instance, unit.substr(unit.rfind('.')));
+  }
+
+  auto expand = [&name_instance](std::string s)
+  {
+    // only instance specifiers are supported
+    for (const auto spec : {"%i", "%I"})
+    {
+      for (auto pos = s.find(spec) ; pos != std::string::npos ; pos = s.find(spec))
+        s.replace(pos, 2, name_instance);
+    }
+    return s;
+  };
+
+  bool ok = true;
+
+  if (section.wanted_by.empty() && section.required_by.empty() && section.alias.empty() && section.also.empty())
+    qInfo() << "Unit " << unit << " has no [Install] section, nothing to enable";
+
+  for (const auto& target : section.wanted_by)
+    ok &= link(ConfigPath / std::format("{}.wants", expand(target)) / name, path);
+
+  for (const auto& target : section.required_by)
+    ok &= link(ConfigPath / std::format("{}.requires", expand(target)) / name, path);
+
+  for (const auto& alias : section.alias)
+    ok &= link(ConfigPath / expand(alias), path);
+
+  for (const auto& also : section.also)
+    ok &= enable(expand(also));
+
+  return ok;
+}
+
+
+fs::path UnitEnabler::find_unit(const std::string_view name) const
+{
+  std::error_code ec;
+
+  for (const auto& dir : UnitPaths)
+  {
+    // only regular files: symlinks in /etc are aliases or masks, and are absolute
+    // paths for the target, so can't be followed from here
+    if (const auto path = dir / name; fs::is_regular_file(fs::symlink_status(m_root / path.relative_path(), ec)))
+      return path;
+  }
+  return {};
+}
+
+
+bool UnitEnabler::read_install_section(const fs::path& path, InstallSection& section) const
+{
+  std::ifstream stream{path};
+
+  if (!stream.good())
+  {
+    qCritical() << "Failed to open " << path.string();
+    return false;
+  }
+
+  auto split = [](const std::string_view value, std::vector<std::string>& dest)
+  {
+    std::istringstream ss{std::string{value}};
+    for (std::string v; ss >> v; )
+      dest.push_back(std::move(v));
+  };
+
+  // "WantedBy = multi-user.target" is valid
+  auto trim = [](const std::string_view s)
+  {
+    const auto start = s.find_first_not_of(" \t");
+    return start == std::string_view::npos ? std::string_view{} : s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+  };
+
+  bool in_install{false};
+
+  for (std::string buffer; std::getline(stream, buffer); )
+  {
+    const std::string_view line = trim(buffer);
+
+    if (line.empty() || line.starts_with('#') || line.starts_with(';'))
+      continue;
+    
+    if (line.starts_with('['))
+    {
+      in_install = line.starts_with("[Install]");
+      continue;
+    }
+
+    if (!in_install)
+      continue;
+    
+    const auto eq = line.find('=');
+    if (eq == std::string::npos)
+      continue;
+    
+    const std::string_view key = trim(line.substr(0, eq));
+    const std::string_view value = trim(line.substr(eq+1));
+    
+    if (key == "WantedBy")
+      split(value, section.wanted_by);
+    else if (key == "RequiredBy")
+      split(value, section.required_by);
+    else if (key == "Alias")
+      split(value, section.alias);
+    else if (key == "Also")
+      split(value, section.also);
+    else if (key == "DefaultInstance")
+      section.default_instance = value;
+  }
+
+  return true;
+}
+
+
+bool UnitEnabler::link(const fs::path& link_path, const fs::path& target) const
+{
+  // link is created in root, but target is absolute within the root, same as systemctl --root
+  const auto full_path = m_root / link_path.relative_path();
+  std::error_code ec;
+
+  if (fs::is_symlink(full_path, ec))
+  {
+    if (fs::read_symlink(full_path, ec) == target)
+      return true;
+    
+    fs::remove(full_path, ec);
+  }
+
+  fs::create_directories(full_path.parent_path(), ec);
+
+  if (fs::create_symlink(target, full_path, ec); ec)
+  {
+    qCritical() << "Failed to create symlink " << full_path.string() << " -> " << target.string() << ": " << ec.message();
+    return false;
+  }
+
+  qInfo() << "Created symlink " << link_path.string() << " -> " << target.string();
+  return true;
+}
+
+
+std::vector<std::string> UnitEnabler::parse_enable_command(const std::string_view cmd)
+{
+  static const std::string_view Prefix {"systemctl enable "};
+
+  std::vector<std::string> units;
+
+  // only a plain enable: options (i.e. --now) and shell syntax need the real systemctl
+  if (!cmd.starts_with(Prefix) || cmd.find_first_of(";|&<>$`'\"\\") != std::string_view::npos)
+    return units;
+  
+  std::istringstream ss{std::string{cmd.substr(Prefix.size())}};
+  for (std::string unit; ss >> unit; )
+  {
+    if (unit.starts_with('-'))
+      return {};
+    units.push_back(std::move(unit));
+  }
+  
+  return units;
+}
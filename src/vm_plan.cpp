@@ -0,0 +1,150 @@
+#include <ali/vm_plan.hpp>
+#include <fstream>
+#include <sstream>
+#include <QDebug>
+
+
+static const fs::path DmiPath {"/sys/class/dmi/id"};
+
+
+static std::string read_line(const fs::path& path)
+{
+  std::string line;
+  if (std::ifstream stream{path}; stream.good())
+    std::getline(stream, line);
+  return line;
+}
+
+
+// the CPUID "hypervisor present" bit
+static bool has_hypervisor_flag()
+{
+  std::ifstream cpuinfo{"/proc/cpuinfo"};
+
+  for (std::string line; std::getline(cpuinfo, line); )
+  {
+    if (line.starts_with("flags"))
+    {
+      std::istringstream flags{line};
+      for (std::string flag; flags >> flag; )
+      {
+        if (flag == "hypervisor")
+          return true;
+      }
+      // all CPUs have the same flags
+      return false;
+    }
+  }
+
+  return false;
+}
+
+
+Hypervisor VmPlan::detect()
+{
+  // Xen PV guests have no DMI
+  if (!has_hypervisor_flag())
+    return read_line("/sys/hypervisor/type") == "xen" ? Hypervisor::Xen : Hypervisor::None;
+
+  const std::string sys_vendor = read_line(DmiPath / "sys_vendor");
+  const std::string product = read_line(DmiPath / "product_name");
+  const std::string bios_vendor = read_line(DmiPath / "bios_vendor");
+
+  auto has = [](const std::string& s, const std::string_view sub) { return s.find(sub) != std::string::npos; };
+
+  if (has(sys_vendor, "QEMU") || has(product, "KVM") || has(bios_vendor, "SeaBIOS") ||
+      has(sys_vendor, "Google") || has(sys_vendor, "Amazon EC2") || has(product, "OpenStack"))
+    return Hypervisor::Kvm;
+  else if (has(sys_vendor, "VMware"))
+    return Hypervisor::VMware;
+  else if (has(sys_vendor, "innotek") || has(product, "VirtualBox"))
+    return Hypervisor::VirtualBox;
+  else if (has(sys_vendor, "Microsoft Corporation") && has(product, "Virtual Machine"))
+    return Hypervisor::HyperV;
+  else if (has(sys_vendor, "Xen") || read_line("/sys/hypervisor/type") == "xen")
+    return Hypervisor::Xen;
+  else if (has(sys_vendor, "Parallels"))
+    return Hypervisor::Parallels;
+  else
+    return Hypervisor::Unknown;
+}
+
+
+VmPlan VmPlan::create(const Hypervisor hypervisor)
+{
+  VmPlan plan{.hypervisor = hypervisor};
+
+  if (!plan.is_vm())
+    return plan;
+
+  plan.zram_size = "min(ram / 4, 2048)";
+
+  switch (hypervisor)
+  {
+    using enum Hypervisor;
+
+    case Kvm:
+      // the agent is started by udev when the VM has the agent channel
+      plan.guest_packages = {"qemu-guest-agent"};
+      plan.initramfs_modules = {"virtio_pci", "virtio_blk", "virtio_scsi"};
+    break;
+
+    case VMware:
+      plan.guest_packages = {"open-vm-tools"};
+      plan.guest_services = {"vmtoolsd.service", "vmware-vmblock-fuse.service"};
+      plan.initramfs_modules = {"vmw_pvscsi"};
+    break;
+
+    case VirtualBox:
+      plan.guest_packages = {"virtualbox-guest-utils-nox"};
+      plan.guest_services = {"vboxservice.service"};
+    break;
+
+    case HyperV:
+      plan.guest_packages = {"hyperv"};
+      plan.guest_services = {"hv_kvp_daemon.service", "hv_vss_daemon.service"};
+      plan.initramfs_modules = {"hv_vmbus", "hv_storvsc"};
+    break;
+
+    case Xen:
+      plan.initramfs_modules = {"xen_blkfront"};
+    break;
+
+    default:
+      // no agent, and the storage driver is unknown
+    break;
+  }
+
+  return plan;
+}
+
+
+const VmPlan& VmPlan::get()
+{
+  static const VmPlan plan = []
+  {
+    const auto plan = create(detect());
+    qInfo() << "Hypervisor: " << plan.name();
+    return plan;
+  }();
+
+  return plan;
+}
+
+
+std::string VmPlan::name() const
+{
+  switch (hypervisor)
+  {
+    using enum Hypervisor;
+
+    case None:        return "None";
+    case Kvm:         return "KVM";
+    case VMware:      return "VMware";
+    case VirtualBox:  return "VirtualBox";
+    case HyperV:      return "Hyper-V";
+    case Xen:         return "Xen";
+    case Parallels:   return "Parallels";
+    default:          return "Unknown hypervisor";
+  }
+}
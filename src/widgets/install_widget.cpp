@@ -1,9 +1,25 @@
 #include <ali/widgets/install_widget.hpp>
 #include <ali/widgets/widgets.hpp>
+#include <ali/package_estimator.hpp>
+#include <ali/system_image.hpp>
+#include <ali/partitioner.hpp>
+
+
+// resuming uses the image directory from the journal
+static bool uses_image(const InstallMode mode)
+{
+  return mode == InstallMode::Capture || mode == InstallMode::Deploy;
+}
 
 
 static const QString waffle_preinstall = R"!(### Install
 - A log file is created in `/var/log/ali/install.log`
+- An image of a complete install can be captured, then deployed to other machines.
+  Deploying only creates the filesystems, bootloader, accounts, network and swap
+- Blank disks can be installed to at the same time: each is partitioned with EFI and root,
+  using the filesystem selected for root. Packages are downloaded once for all disks
+- A failed install can be resumed: select the same partitions, without creating filesystems.
+  Completed stages are skipped
 
 ---
 
@@ -40,7 +56,7 @@ may not start correctly or there may be missing packages.
 static const QString waffle_install_min_ok = R"!(
 The minimal has installed successfully to boot. 
 
-Now installing profile packages.
+Now finishing the install.
 
 ---
 
@@ -94,6 +110,38 @@ InstallWidget::InstallWidget() : ContentWidget("Install")
   m_lbl_waffle->setWordWrap(true);
   m_lbl_waffle->setTextFormat(Qt::TextFormat::MarkdownText);
 
+  m_lbl_estimate = new QLabel;
+  m_lbl_estimate->setWordWrap(true);
+  m_lbl_estimate->setTextFormat(Qt::TextFormat::MarkdownText);
+
+  m_mode = new QComboBox;
+  m_mode->addItem("Install", static_cast<int>(InstallMode::Full));
+  m_mode->addItem("Install and capture image", static_cast<int>(InstallMode::Capture));
+  m_mode->addItem("Deploy image", static_cast<int>(InstallMode::Deploy));
+  m_mode->addItem("Resume failed install", static_cast<int>(InstallMode::Resume));
+
+  m_image_dir = new QLineEdit;
+  m_image_dir->setPlaceholderText("Image directory");
+  m_image_dir->setEnabled(false);
+
+  QHBoxLayout * mode_layout = new QHBoxLayout;
+  mode_layout->setAlignment(Qt::AlignHCenter);
+  mode_layout->addWidget(m_mode);
+  mode_layout->addWidget(m_image_dir);
+
+  connect(m_mode, &QComboBox::currentIndexChanged, this, [this]
+  {
+    m_image_dir->setEnabled(uses_image(get_mode()));
+
+    // each target would capture to the same image. Resuming is only the selected partitions
+    if (m_targets)
+      m_targets->setEnabled(get_mode() != InstallMode::Capture && get_mode() != InstallMode::Resume);
+
+    validate();
+  });
+
+  connect(m_image_dir, &QLineEdit::editingFinished, this, &InstallWidget::validate);
+
   m_btn_install = new QPushButton("Install");
   m_btn_install->setMaximumWidth(100);
   
@@ -106,69 +154,73 @@ InstallWidget::InstallWidget() : ContentWidget("Install")
   m_lbl_busy->setAutoFillBackground(true);
   m_lbl_busy->setStyleSheet("QLabel { background-color: green; }");
   
+  // commands are terminated, then the targets unmounted
+  m_btn_cancel = new QPushButton("Cancel");
+  m_btn_cancel->setMaximumWidth(100);
+  m_btn_cancel->hide();
+  
   install_icon_layout->addWidget(m_btn_install, 0, Qt::AlignHCenter);
+  install_icon_layout->addWidget(m_btn_cancel, 0, Qt::AlignHCenter);
 
   m_log_widget = new LogWidget;
+
+  // a tab per target
+  m_logs = new QTabWidget;
+  m_logs->addTab(m_log_widget, QString::fromStdString(RootMnt.string()));
+  m_logs->tabBar()->hide();
   
   layout->addWidget(m_lbl_waffle);
+  layout->addWidget(m_lbl_estimate);
   layout->addStretch(1);
+  layout->addLayout(mode_layout);
+
+  if (auto targets = create_targets(); targets)
+    layout->addWidget(targets);
+
   layout->addLayout(install_icon_layout);
-  layout->addWidget(m_log_widget);
+  layout->addWidget(m_logs);
   
   setLayout(layout);
 
-  connect(&m_installer, &Install::on_stage_start, this, [this](const QString msg)
-  {
-    m_log_widget->appendHtml("<b>" + msg + "</b>");
-  });
-
-  connect(&m_installer, &Install::on_stage_end, this, [this](const QString msg)
-  {
-    m_log_widget->appendHtml("<b>" + msg + "</b>");
-  });
-
-  connect(&m_installer, &Install::on_log_info, this, [this](const QString msg)
-  {
-    m_log_widget->appendPlainText(msg);
-  });
-
-  connect(&m_installer, &Install::on_log_critical, this, [this](const QString msg)
-  {
-    m_log_widget->appendHtml("<span style=\"background-color: #800517; color:white;\">"+ msg + "</span>");
-  });
-
-  connect(&m_installer, &Install::on_log_warning, this, [this](const QString msg)
-  {
-    m_log_widget->appendHtml("<span style=\"background-color: #CC7722; color:white;\">"+ msg + "</span>");
-  });
+  connect_log(m_installer, m_log_widget);
 
   connect(&m_installer, &Install::on_complete, this, [this](const CompleteStatus state)
   {
     bool enable_nav {false};
 
+    set_target_status(0, state);
+
+    if (state != CompleteStatus::MinimalSuccess)
+      m_btn_cancel->hide();
+
     switch (state)
     {
       using enum CompleteStatus;
 
       case MinimalSuccess:
         m_btn_install->hide();
+        m_lbl_estimate->hide();
         m_lbl_waffle->setText(waffle_install_min_ok);
       break;
 
       case MinimalFail:
         enable_nav = true;
-        m_btn_install->setEnabled(true);        
-        m_btn_install->setText("Install");
         m_lbl_waffle->setText(waffle_install_min_fail);
+
+        // other targets may still be installing
+        if (m_multi_installers.empty())
+          enable_install();
       break;
 
       case ExtraSuccess:
         m_btn_install->hide();
+        m_lbl_estimate->hide();
         m_lbl_waffle->setText(waffle_install_extra_ok);
       break;
 
       case ExtraFail:
         m_btn_install->hide();
+        m_lbl_estimate->hide();
         m_lbl_waffle->setText(waffle_install_extra_fail);
       break;
 
@@ -184,13 +236,195 @@ InstallWidget::InstallWidget() : ContentWidget("Install")
   #ifdef ALI_PROD
     connect(m_btn_install, &QPushButton::clicked, this, &InstallWidget::install);
   #endif
+
+  connect(m_btn_cancel, &QPushButton::clicked, this, &InstallWidget::cancel);
+}
+
+
+void InstallWidget::connect_log(Install& installer, LogWidget * log)
+{
+  connect(&installer, &Install::on_stage_start, this, [log](const QString msg)
+  {
+    log->appendHtml("<b>" + msg + "</b>");
+  });
+
+  connect(&installer, &Install::on_stage_end, this, [log](const QString msg)
+  {
+    log->appendHtml("<b>" + msg + "</b>");
+  });
+
+  connect(&installer, &Install::on_log_info, this, [log](const QString msg)
+  {
+    log->appendPlainText(msg);
+  });
+
+  connect(&installer, &Install::on_log_critical, this, [log](const QString msg)
+  {
+    log->appendHtml("<span style=\"background-color: #800517; color:white;\">"+ msg + "</span>");
+  });
+
+  connect(&installer, &Install::on_log_warning, this, [log](const QString msg)
+  {
+    log->appendHtml("<span style=\"background-color: #CC7722; color:white;\">"+ msg + "</span>");
+  });
+}
+
+
+void InstallWidget::set_target_status(const int tab, const CompleteStatus status)
+{
+  if (m_logs->count() < 2)
+    return;
+
+  const char * status_text = "";
+
+  switch (status)
+  {
+    using enum CompleteStatus;
+
+    case MinimalSuccess:  status_text = "Finishing";          break;
+    case MinimalFail:     status_text = "Failed";             break;
+    case ExtraSuccess:    status_text = "Complete";           break;
+    case ExtraFail:       status_text = "Complete (extras failed)"; break;
+  }
+
+  m_logs->setTabText(tab, QString::fromStdString(std::format("{} - {}", InstallTarget::multi(tab + 1).name(), status_text)));
+}
+
+
+// blank disks which are installed to, concurrently with the selected partitions
+QWidget * InstallWidget::create_targets()
+{
+  m_blank_disks = PartitionUtils::blank_disks();
+
+  if (m_blank_disks.empty())
+    return nullptr;
+
+  m_targets = new QListWidget;
+  m_targets->setMaximumHeight(100);
+
+  for (const auto& disk : m_blank_disks)
+  {
+    const auto text = std::format("{} ({}, {})", disk.dev, format_size(disk.size), device_class_name(disk.dev_class));
+
+    auto item = new QListWidgetItem(QString::fromStdString(text), m_targets);
+    item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+    item->setCheckState(Qt::Unchecked);
+  }
+
+  QWidget * widget = new QWidget;
+  QFormLayout * layout = new QFormLayout;
+  layout->addRow("Also install to", m_targets);
+  widget->setLayout(layout);
+
+  return widget;
+}
+
+
+BlankDisks InstallWidget::get_target_disks() const
+{
+  BlankDisks disks;
+
+  if (m_targets && m_targets->isEnabled())
+  {
+    for (int i = 0 ; i < m_targets->count() ; ++i)
+    {
+      if (m_targets->item(i)->checkState() == Qt::Checked)
+        disks.push_back(m_blank_disks[i]);
+    }
+  }
+
+  return disks;
+}
+
+
+// Partition the disks with EFI and root. The filesystems are as the primary's root, /home is on root.
+// Runs on m_partition_thread, so messages are kept in m_partition_log until the installs start.
+std::vector<MountData> InstallWidget::partition_targets(const BlankDisks& disks, const MountData& primary)
+{
+  m_partition_log.clear();
+
+  std::vector<std::string> partitioned;
+
+  for (const auto& disk : disks)
+  {
+    if (const auto plan = PartitionPlan::create_default(disk.dev, disk.size, false); !plan.is_valid(disk.size))
+      m_partition_log.push_back(std::format("{} is too small, not installing to it", disk.dev));
+    else if (!Partitioner::create(plan))
+      m_partition_log.push_back(std::format("Failed to partition {}, not installing to it", disk.dev));
+    else
+      partitioned.push_back(disk.dev);
+  }
+
+  // new partitions must be in the probe results, i.e. to get their UUIDs for fstab
+  PartitionUtils::probe_for_install();
+
+  std::vector<MountData> targets;
+
+  for (const auto& disk : partitioned)
+  {
+    Partitions parts = PartitionUtils::partitions();
+    std::erase_if(parts, [&disk](const Partition& part)
+    {
+      return part.parent_dev != disk;
+    });
+
+    std::sort(parts.begin(), parts.end(), [](const Partition& a, const Partition& b){ return a.part_number < b.part_number; });
+
+    if (parts.size() != 2)
+    {
+      m_partition_log.push_back(std::format("Unexpected partitions on {}, not installing to it", disk));
+      continue;
+    }
+
+    MountData mounts;
+    mounts.efi = MountData::Mount{.dev = parts[0].dev, .fs = "vfat", .create_fs = true};
+    mounts.root = MountData::Mount{.dev = parts[1].dev, .fs = primary.root.fs, .create_fs = true};
+    mounts.home = MountData::Mount{.dev = parts[1].dev, .fs = primary.root.fs, .create_fs = false};
+    mounts.btrfs = primary.btrfs;
+    
+    targets.push_back(std::move(mounts));
+  }
+
+  return targets;
 }
 
 
 InstallWidget::~InstallWidget()
 {
-  // TODO don't need to join install thread, but may need
-  //      a way to cancel the install
+  // the installers are destroyed before m_install_thread would join
+  cancel();
+
+  if (m_partition_thread.joinable())
+    m_partition_thread.join();
+
+  if (m_install_thread.joinable())
+    m_install_thread.join();
+
+  m_multi_threads.clear();
+}
+
+
+// Each install thread's stop_token is checked by its commands and between stages
+void InstallWidget::cancel()
+{
+  m_partition_thread.request_stop();
+  m_install_thread.request_stop();
+
+  for (auto& thread : m_multi_threads)
+    thread.request_stop();
+
+  m_btn_cancel->setEnabled(false);
+  m_btn_cancel->setText("Cancelling ...");
+}
+
+
+// after a failed or cancelled install, another can start
+void InstallWidget::enable_install()
+{
+  m_btn_install->setEnabled(true);
+  m_btn_install->setText("Install");
+  m_mode->setEnabled(true);
+  m_image_dir->setEnabled(uses_image(get_mode()));
 }
 
 
@@ -217,12 +451,61 @@ void InstallWidget::validate()
     }
   }
   
+  if (valid && uses_image(get_mode()))
+  {
+    const fs::path image_dir {m_image_dir->text().toStdString()};
+
+    if (image_dir.empty() || !image_dir.is_absolute())
+      valid = false;
+    else if (get_mode() == InstallMode::Deploy)
+      valid = SystemImage::is_image(image_dir);
+
+    if (!valid)
+      qWarning() << "Invalid image directory: " << m_image_dir->text();
+  }
+
   if (valid)
   {
     qInfo() << "Validation passed";
   }
   
   m_btn_install->setEnabled(valid);
+
+  show_estimate();
+}
+
+
+void InstallWidget::show_estimate()
+{
+  const auto estimate = PackageEstimator::estimate_selected();
+
+  if (!estimate)
+  {
+    m_lbl_estimate->setText("Package sizes are not available yet.");
+    return;
+  }
+
+  std::string text = std::format("**Packages:** {} (including dependencies)  \n**Download:** {}  \n**Installed:** {}",
+                                 estimate->packages, format_size(estimate->download_size), format_size(estimate->installed_size));
+
+  if (const auto eta = PackageEstimator::eta(*estimate); eta)
+  {
+    const auto speed = PackageEstimator::download_speed().value_or(0);
+    text += std::format("  \n**Download time:** ~{} min at {}/s", std::max<int64_t>(1, (eta->count() + 59) / 60), format_size(speed));
+  }
+  
+  if (!estimate->unresolved.empty())
+    qWarning() << "Estimate could not resolve: " << estimate->unresolved.size() << " packages/dependencies";
+
+  qInfo() << "Estimate: " << estimate->packages << " packages, download: " << estimate->download_size << ", installed: " << estimate->installed_size;
+
+  m_lbl_estimate->setText(QString::fromStdString(text));
+}
+
+
+InstallMode InstallWidget::get_mode() const
+{
+  return static_cast<InstallMode>(m_mode->currentData().toInt());
 }
 
 
@@ -236,12 +519,107 @@ void InstallWidget::install()
   {
     m_btn_install->setText("Installing ...");
     m_btn_install->setEnabled(false);
+    m_btn_cancel->setText("Cancel");
+    m_btn_cancel->setEnabled(true);
+    m_btn_cancel->show();
     
     emit on_install_begin();
 
-    m_install_thread = std::move(std::jthread([this]
+    m_mode->setEnabled(false);
+    m_image_dir->setEnabled(false);
+
+    const auto mode = get_mode();
+    const fs::path image_dir {m_image_dir->text().toStdString()};
+    const auto [_, mounts] = Widgets::partitions()->get_data();
+    const auto disks = get_target_disks();
+
+    if (m_targets)
+      m_targets->setEnabled(false);
+
+    if (disks.empty())
+    {
+      m_install_thread = std::move(std::jthread([this, mode, image_dir, mounts](std::stop_token stop)
+      {
+        Command::set_stop_token(stop);
+        m_installer.install(InstallTarget::single(), mounts, mode, image_dir);
+        qInfo() << "Install thread done";
+      }));
+    }
+    else
+    {
+      // libfdisk and the probe are slow for several disks, so not on the UI thread. The
+      // installs start after, because the probe excludes mounted partitions
+      m_log_widget->appendPlainText(QString::fromStdString(std::format("Partitioning {} disks", disks.size())));
+
+      connect(this, &InstallWidget::on_targets_partitioned, this, [this, mode, image_dir, mounts]
+      {
+        for (const auto& msg : m_partition_log)
+          m_log_widget->appendPlainText(QString::fromStdString(msg));
+
+        if (m_partition_thread.get_stop_token().stop_requested())
+        {
+          m_log_widget->appendPlainText("Cancelled");
+          m_btn_cancel->hide();
+          enable_install();
+          emit on_install_end();
+        }
+        else
+          install_targets(m_partitioned, mounts, mode, image_dir);
+      }, Qt::SingleShotConnection);
+
+      m_partition_thread = std::jthread([this, disks, mounts]
+      {
+        m_partitioned = partition_targets(disks, mounts);
+        emit on_targets_partitioned();
+      });
+    }
+  }
+  catch(const std::exception& e)
+  {
+    emit on_install_end();
+
+    m_log_widget->appendPlainText(QString::fromStdString(std::format("ERROR: exception: {}", e.what())));
+    qCritical() << e.what();
+  }
+}
+
+
+// the selected partitions are the first target, the partitioned disks the others
+void InstallWidget::install_targets(const std::vector<MountData>& targets, const MountData& mounts, const InstallMode mode, const fs::path& image_dir)
+{
+  try
+  {
+    m_shared = std::make_unique<SharedInstall>(targets.size() + 1);
+    m_logs->tabBar()->show();
+    m_logs->setTabText(0, QString::fromStdString(InstallTarget::multi(1).name()));
+
+    for (std::size_t i = 0 ; i < targets.size() ; ++i)
+    {
+      const auto target = InstallTarget::multi(static_cast<int>(i) + 2);
+      const int tab = static_cast<int>(i) + 1;
+
+      auto& installer = *m_multi_installers.emplace_back(std::make_unique<Install>());
+      auto log = new LogWidget;
+
+      m_logs->addTab(log, QString::fromStdString(target.name()));
+      connect_log(installer, log);
+      connect(&installer, &Install::on_complete, this, [this, tab](const CompleteStatus state)
+      {
+        set_target_status(tab, state);
+      });
+      
+      m_multi_threads.emplace_back([this, &installer, target, mounts = targets[i], mode, image_dir](std::stop_token stop)
+      {
+        Command::set_stop_token(stop);
+        installer.install(target, mounts, mode, image_dir, m_shared.get());
+        qInfo() << "Install thread done: " << target.name();
+      });
+    }
+
+    m_install_thread = std::move(std::jthread([this, mode, image_dir, mounts](std::stop_token stop)
     {
-      m_installer.install();
+      Command::set_stop_token(stop);
+      m_installer.install(InstallTarget::multi(1), mounts, mode, image_dir, m_shared.get());
       qInfo() << "Install thread done";
     }));
   }
@@ -1,6 +1,8 @@
 #include <ali/widgets/packages_widget.hpp>
 #include <ali/commands.hpp>
 #include <ali/packages.hpp>
+#include <ali/firmware_planner.hpp>
+#include <ali/vm_plan.hpp>
 #include <barrier>
 #include <QtTypes>
 
@@ -137,8 +139,9 @@ private:
     // Packages uses a set so we avoid duplicates and the UI will reflect
     // exactly what will be installed
     m_confirmed_packages->clear();
-    for (const auto& pkg : Packages::additional())
-      m_confirmed_packages->addItem(pkg.name);
+    const auto additional = Packages::additional();
+    for (const auto& name : additional.names())
+      m_confirmed_packages->addItem(QString::fromStdString(name));
   }
 
 
@@ -297,10 +300,21 @@ PackagesWidget::PackagesWidget() : ContentWidget("Packages")
   }
 
   {
-    m_firmware = SelectPackagesWidget::none_required({"linux-firmware", "linux-firmware-marvell"}, Type::Firmware);
+    // only the firmware for this machine's devices is selected, the full set remains an option
+    const auto plan = FirmwarePlanner::plan();
+
+    QMap<QString, bool> firmware {{FirmwarePlanner::FullPackage, false}};
+    for (const auto& package : plan.packages)
+      firmware[package] = true;
+
+    m_firmware = SelectPackagesWidget::none_required(firmware, Type::Firmware);
+
+    QVBoxLayout * firmware_layout = new QVBoxLayout;
+    firmware_layout->addWidget(new QLabel{QString::fromStdString(plan.summary())});
+    firmware_layout->addWidget(m_firmware);
     
     QGroupBox * group_firmware = new QGroupBox("Firmware");
-    group_firmware->setLayout(m_firmware->layout());    
+    group_firmware->setLayout(firmware_layout);
 
     layout->addWidget(group_firmware);
   }
@@ -310,7 +324,10 @@ PackagesWidget::PackagesWidget() : ContentWidget("Packages")
     const CpuVendor cpu_vendor = cpu_vendor_cmd.get_vendor();
     const QString cpu_ucode = cpu_vendor == CpuVendor::Amd ? "amd-ucode" : "intel-ucode";
     
-    m_important = SelectPackagesWidget::none_required({{"sudo",true}, {cpu_ucode, true}, {"nano", true}, {"wireless-regdb", true}, {"openssh", true}}, Type::Important);
+    // the host applies microcode, not a VM
+    const bool ucode = !VmPlan::get().is_vm();
+
+    m_important = SelectPackagesWidget::none_required({{"sudo",true}, {cpu_ucode, ucode}, {"nano", true}, {"wireless-regdb", true}, {"openssh", true}}, Type::Important);
     
     QGroupBox * group_important = new QGroupBox("Important");
     group_important->setLayout(m_important->layout());    
@@ -318,6 +335,21 @@ PackagesWidget::PackagesWidget() : ContentWidget("Packages")
     layout->addWidget(group_important);
   }
 
+  if (const auto& vm = VmPlan::get(); !vm.guest_packages.isEmpty())
+  {
+    QMap<QString, bool> guest;
+    for (const auto& package : vm.guest_packages)
+      guest[package] = true;
+
+    // installed with the important packages, the install enables their services
+    m_vm = SelectPackagesWidget::none_required(guest, Type::Important);
+
+    QGroupBox * group_vm = new QGroupBox(QString::fromStdString(std::format("Virtual Machine ({})", vm.name())));
+    group_vm->setLayout(m_vm->layout());
+
+    layout->addWidget(group_vm);
+  }
+
   {
     m_shell = SelectPackagesWidget::one_required({"bash", "zsh", "ksh", "fish", "nushell"}, Type::Shell);
     
@@ -1,8 +1,13 @@
 #include <ali/widgets/partitions_widget.hpp>
+#include <ali/partitioner.hpp>
+#include <ali/package_estimator.hpp>
 #include <QVBoxLayout>
 #include <QFormLayout>
 #include <QComboBox>
 #include <QCheckBox>
+#include <QSpinBox>
+#include <QPushButton>
+#include <QMessageBox>
 #include <QTableWidget>
 #include <QTableWidgetItem>
 
@@ -63,6 +68,12 @@ You need a GPT label on the device, with at least two partitions (`/` and `/boot
 Use `fdisk <dev>` or `cfdisk <dev>`.
 - Boot partition should be **at least** 512MB, preferably 1GB
 - Root partition should be **at least** 8GB, preferably 32GB
+
+<br/>
+
+### Blank Disks
+Disks without a partition table or filesystem are listed below. ali can create a GPT label with
+an EFI (1GB) and root partition, and optionally a separate home partition (root is then 64GB).
 )!";
 
 
@@ -78,20 +89,26 @@ static const QStringList SupportedEfiFs =
 };
 
 
-
-static std::string format_size(const int64_t size)
+// empty if / is large enough. Only checked if the sync db is ready, the size is an estimate anyway
+static QString root_size_error(const MountData& mounts)
 {
-  static const char *sizeNames[] = {"B", "KB", "MB", "GB", "TB", "PB"};
+  const auto estimate = PackageEstimator::estimate_selected();
 
-  std::string result;
+  if (!estimate)
+    return {};
 
-  const uint64_t i = (uint64_t) std::floor(std::log(size) / std::log(1024));
-  const auto display_size = size / std::pow(1024, i);
-  
-  return std::format("{:.1f} {}", display_size, sizeNames[i]);
+  // allow for the pacman cache, logs, initramfs, etc and more if /home shares root
+  const bool shared_home = mounts.home.dev == mounts.root.dev;
+  const uint64_t required = estimate->installed_size + estimate->download_size + (shared_home ? 8 : 2) * 1024ULL * 1024 * 1024;
+
+  if (const auto root_size = PartitionUtils::get_partition_size(mounts.root.dev); root_size > 0 && static_cast<uint64_t>(root_size) < required)
+    return QString::fromStdString(std::format("/ ({}) is {}, the selected packages require an estimated {}", mounts.root.dev, format_size(root_size), format_size(required)));
+
+  return {};
 }
 
 
+
 struct SelectMounts : public QWidget
 {
   SelectMounts(QWidget * parent = nullptr) : QWidget(parent)
@@ -127,6 +144,22 @@ struct SelectMounts : public QWidget
     m_home_fs->setMaximumWidth(200);
 
     m_home_to_root = new QCheckBox("Mount /home to root partition");
+
+    // btrfs mount profile
+    m_btrfs_level = new QSpinBox;
+    m_btrfs_level->setMaximumWidth(100);
+    m_btrfs_level->setRange(0, BtrfsMountProfile::MaxZstdLevel);
+    m_btrfs_level->setSpecialValueText("None");   // shown for 0
+    m_btrfs_level->setPrefix("zstd:");
+    m_btrfs_level->setValue(m_mounts.btrfs.zstd_level);
+
+    m_btrfs_noatime = new QCheckBox("noatime");
+    m_btrfs_noatime->setChecked(m_mounts.btrfs.noatime);
+
+    auto btrfs_layout = new QHBoxLayout;
+    btrfs_layout->addWidget(m_btrfs_level);
+    btrfs_layout->addWidget(m_btrfs_noatime);
+    btrfs_layout->addStretch(1);
     
     auto root_layout = new QHBoxLayout;
     root_layout->addWidget(m_root_dev);
@@ -159,6 +192,7 @@ struct SelectMounts : public QWidget
     mounts_layout->addRow("/efi", efi_layout);
     mounts_layout->addRow("/home", home_layout);
     mounts_layout->addRow("", m_home_to_root);
+    mounts_layout->addRow("btrfs compression", btrfs_layout);
         
     layout->addLayout(mounts_layout);
     layout->addSpacing(50);
@@ -232,6 +266,17 @@ struct SelectMounts : public QWidget
       update_mount_data();
     });
 
+    // btrfs
+    connect(m_btrfs_level, &QSpinBox::valueChanged, this, [this](const int)
+    {
+      update_mount_data();
+    });
+
+    connect(m_btrfs_noatime, &QCheckBox::checkStateChanged, this, [this](const Qt::CheckState)
+    {
+      update_mount_data();
+    });
+
     
     m_home_to_root->setChecked(true);
 
@@ -265,6 +310,13 @@ struct SelectMounts : public QWidget
       m_mounts.home.fs = m_mounts.home.create_fs ?  m_home_fs->currentText().toStdString() :
                                                     PartitionUtils::get_partition_fs(m_mounts.home.dev);
     }
+
+    m_mounts.btrfs.zstd_level = m_btrfs_level->value();
+    m_mounts.btrfs.noatime = m_btrfs_noatime->isChecked();
+
+    const bool have_btrfs = m_mounts.root.fs == "btrfs" || m_mounts.home.fs == "btrfs";
+    m_btrfs_level->setEnabled(have_btrfs);
+    m_btrfs_noatime->setEnabled(have_btrfs);
     
     if (summary)
       update_summary();
@@ -295,6 +347,9 @@ struct SelectMounts : public QWidget
     ss << "| /efi |"  << efi_dev << "|" << efi_fs << "|"  << efi_create_fs << "|\n";
     ss << "| /home |" << home_dev << "|"<< home_fs << "|" << home_create_fs << "|\n";
 
+    if (root_fs == "btrfs" || home_fs == "btrfs")
+      ss << "\nbtrfs: " << QString::fromStdString(m_mounts.btrfs.summary()) << "\n\n";
+
     if (root_dev == efi_dev)
       ss << "<span style=\"color:red;\">/ and /boot cannot be the same partition</span>\n";
     else if (home_dev == efi_dev)
@@ -313,10 +368,21 @@ struct SelectMounts : public QWidget
     if (home_fs != root_fs && home_fs.isEmpty())
       ss << "<span style=\"color:red;\">/home has no filesystem</span>\n";
 
+    if (const auto error = root_size_error(m_mounts); !error.isEmpty())
+      ss << "<span style=\"color:red;\">" << error << "</span>\n";
+
     m_summary->setText(m_summary_text);
   }
 
 
+  // the estimate changes with the selected packages, on other pages
+  void showEvent(QShowEvent * event) override
+  {
+    update_summary();
+    QWidget::showEvent(event);
+  }
+
+
   void add_efi(const QString& dev)
   {
     m_efi_dev->addItem(dev);
@@ -344,6 +410,8 @@ private:
   QComboBox * m_efi_dev, * m_root_dev, * m_home_dev;
   QComboBox * m_efi_fs, * m_root_fs, * m_home_fs;
   QCheckBox * m_home_to_root;
+  QSpinBox * m_btrfs_level;
+  QCheckBox * m_btrfs_noatime;
   QLabel * m_summary; 
   MountData m_mounts;
   QString m_summary_text;
@@ -353,13 +421,31 @@ private:
 PartitionsWidget::PartitionsWidget() : ContentWidget("Mounts")
 {
   QVBoxLayout * layout = new QVBoxLayout;
+  layout->setAlignment(Qt::AlignTop);
   setLayout(layout);
   
+  populate();
+}
+
+
+void PartitionsWidget::populate()
+{
+  // this is called again after creating partitions, so clear previous
+  while (auto item = layout()->takeAt(0))
+  {
+    if (item->widget())
+      item->widget()->deleteLater();
+    delete item;
+  }
+
+  m_mounts_widget = nullptr;
+
+  auto layout = static_cast<QVBoxLayout *>(this->layout());
+
   QTextEdit * lbl_title = new QTextEdit;
   lbl_title->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);  
   lbl_title->setReadOnly(true);
   
-  layout->setAlignment(Qt::AlignTop);
   layout->addWidget(lbl_title);
     
   PartitionUtils::probe_for_install();
@@ -380,7 +466,60 @@ PartitionsWidget::PartitionsWidget() : ContentWidget("Mounts")
     lbl_title->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Maximum);
     lbl_title->setFixedHeight(600);
     lbl_title->setMarkdown(waffle_title_no_parts);
+
+    if (auto blank = create_blank_disks(); blank)
+      layout->addWidget(blank);
+  }
+}
+
+
+QWidget * PartitionsWidget::create_blank_disks()
+{
+  const auto disks = PartitionUtils::blank_disks();
+
+  if (disks.empty())
+    return nullptr;
+
+  QComboBox * combo_disks = new QComboBox;
+  QCheckBox * chk_home = new QCheckBox;
+  QPushButton * btn_create = new QPushButton("Create Partitions");
+
+  for (const auto& disk : disks)
+  {
+    const auto text = std::format("{} ({}, {})", disk.dev, format_size(disk.size), device_class_name(disk.dev_class));
+    combo_disks->addItem(QString::fromStdString(text), QString::fromStdString(disk.dev));
   }
+
+  connect(btn_create, &QPushButton::clicked, this, [this, disks, combo_disks, chk_home]()
+  {
+    const auto& disk = disks[combo_disks->currentIndex()];
+    const auto plan = PartitionPlan::create_default(disk.dev, disk.size, chk_home->isChecked());
+
+    if (!plan.is_valid(disk.size))
+    {
+      QMessageBox::warning(this, "Partitions", "The disk is too small");
+      return;
+    }
+
+    const auto msg = std::format("Create a GPT label and {} partitions on {}?", plan.parts.size(), disk.dev);
+
+    if (QMessageBox::question(this, "Partitions", QString::fromStdString(msg)) != QMessageBox::Yes)
+      return;
+    
+    if (!Partitioner::create(plan))
+      QMessageBox::critical(this, "Partitions", "Failed to create partitions, see the log");
+    
+    populate();
+  });
+
+  QWidget * widget = new QWidget;
+  QFormLayout * layout = new QFormLayout;
+  layout->addRow("Disk", combo_disks);
+  layout->addRow("Separate /home", chk_home);
+  layout->addRow("", btn_create);
+  widget->setLayout(layout);
+  
+  return widget;
 }
 
 
@@ -451,7 +590,20 @@ bool PartitionsWidget::is_valid()
   const bool home_ok = !mounts.home.dev.empty() && !mounts.home.fs.empty();
   const bool efi_root_same = mounts.root.dev == mounts.efi.dev;
   
-  return root_ok && efi_ok && home_ok && !efi_root_same;
+  return root_ok && efi_ok && home_ok && !efi_root_same && is_root_size_valid(mounts);
+}
+
+
+bool PartitionsWidget::is_root_size_valid(const MountData& mounts)
+{
+  // also shown in the summary
+  if (const auto error = root_size_error(mounts); !error.isEmpty())
+  {
+    qWarning() << error;
+    return false;
+  }
+
+  return true;
 }
 
 
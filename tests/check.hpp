@@ -0,0 +1,20 @@
+#ifndef ALI_TESTS_CHECK_H
+#define ALI_TESTS_CHECK_H
+
+#include <iostream>
+
+
+// Minimal checks for the tests, each a standalone executable run by `meson test`.
+// A failed check is reported and the test's exit code is non-zero.
+inline int failures{0};
+
+#define CHECK(expr) \
+  do { \
+    if (!(expr)) \
+    { \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": failed: " << #expr << '\n'; \
+      ++failures; \
+    } \
+  } while (false)
+
+#endif
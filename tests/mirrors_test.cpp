@@ -0,0 +1,155 @@
+#include <ali/mirrors.hpp>
+#include "check.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+static constexpr std::size_t DbSize = 2 * 1024 * 1024;  // larger than Mirrors::ProbeBytes, as extra.db is
+static constexpr std::chrono::milliseconds SlowDelay {500};
+
+
+// Serves extra.db for the servers "/fast/$repo/os/$arch" and "/slow/$repo/os/$arch", the
+// slow one after a delay, and 404 for anything else. A thread per connection because
+// mirrors are probed concurrently.
+class HttpServer
+{
+public:
+  HttpServer()
+  {
+    m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in addr {.sin_family = AF_INET, .sin_port = 0, .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)}};
+    socklen_t len = sizeof(addr);
+
+    if (::bind(m_fd, reinterpret_cast<sockaddr*>(&addr), len) == 0 && ::listen(m_fd, 16) == 0 &&
+        ::getsockname(m_fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0)
+    {
+      m_port = ntohs(addr.sin_port);
+      m_thread = std::jthread{[this]{ serve(); }};
+    }
+  }
+
+  ~HttpServer()
+  {
+    // accept() returns when the socket is shutdown
+    ::shutdown(m_fd, SHUT_RDWR);
+    m_thread = {};
+    m_clients.clear();
+    ::close(m_fd);
+  }
+
+  uint16_t port() const { return m_port; }
+
+private:
+  void serve()
+  {
+    for (int client ; (client = ::accept(m_fd, nullptr, nullptr)) >= 0 ; )
+      m_clients.emplace_back([client]{ respond(client); });
+  }
+
+  static void respond(const int client)
+  {
+    std::string request(4096, '\0');
+    request.resize(std::max<ssize_t>(::recv(client, request.data(), request.size(), 0), 0));
+
+    // "GET /fast/extra/os/x86_64/extra.db HTTP/1.1"
+    const std::string path = request.substr(4, request.find(' ', 4) - 4);
+    const bool found = path.ends_with("/extra/os/x86_64/extra.db") && (path.starts_with("/fast/") || path.starts_with("/slow/"));
+
+    if (path.starts_with("/slow/"))
+      std::this_thread::sleep_for(SlowDelay);
+
+    std::string response = found ? std::format("HTTP/1.1 200 OK\r\nContent-Length: {}\r\nConnection: close\r\n\r\n", DbSize) :
+                                   std::string{"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"};
+    if (found)
+      response.append(DbSize, 'x');
+
+    for (std::size_t sent = 0 ; sent < response.size() ; )
+    {
+      const ssize_t n = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0)
+        break;
+      sent += n;
+    }
+
+    ::close(client);
+  }
+
+private:
+  int m_fd{-1};
+  uint16_t m_port{0};
+  std::vector<std::jthread> m_clients;  // only modified by the serve thread
+  std::jthread m_thread;
+};
+
+
+// a port which refuses connections: bound then closed
+static uint16_t closed_port()
+{
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr {.sin_family = AF_INET, .sin_port = 0, .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)}};
+  socklen_t len = sizeof(addr);
+
+  ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len);
+  ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  ::close(fd);
+
+  return ntohs(addr.sin_port);
+}
+
+
+int main()
+{
+  const fs::path dir {fs::temp_directory_path() / std::format("ali-mirrors-{}", ::getpid())};
+  fs::create_directories(dir);
+
+  HttpServer server;
+  CHECK(server.port() != 0);
+
+  const auto url = [](const uint16_t port, const std::string_view name)
+  {
+    return std::format("http://127.0.0.1:{}/{}/$repo/os/$arch", port, name);
+  };
+
+  const std::string fast {url(server.port(), "fast")};
+  const std::string slow {url(server.port(), "slow")};
+  const std::string missing {url(server.port(), "missing")};
+  const std::string refused {url(closed_port(), "fast")};
+
+  // commented servers are candidates, one also enabled is probed once
+  std::ofstream{dir / "mirrorlist"} << std::format("## Worldwide\n# Server = {}\n#Server = {}\nServer = {}\nServer = {}\nServer = {}\n",
+                                                   fast, slow, missing, refused, fast);
+
+  const auto ranked = Mirrors::rank(dir / "mirrorlist");
+
+  // the 404 and the refused connection are excluded
+  CHECK(ranked.size() == 2);
+
+  if (ranked.size() == 2)
+  {
+    CHECK(ranked[0].server == fast);
+    CHECK(ranked[1].server == slow);
+    CHECK(ranked[0].speed > ranked[1].speed);
+    CHECK(ranked[1].latency >= std::chrono::duration<double>{SlowDelay}.count());
+  }
+
+  // written fastest first
+  CHECK(Mirrors::write(dir / "ranked", ranked));
+
+  std::stringstream written;
+  written << std::ifstream{dir / "ranked"}.rdbuf();
+  CHECK(written.str().find("Server = " + fast) < written.str().find("Server = " + slow));
+
+  CHECK(Mirrors::rank(dir / "none").empty());
+
+  fs::remove_all(dir);
+  return failures == 0 ? 0 : 1;
+}
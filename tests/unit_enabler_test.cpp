@@ -0,0 +1,46 @@
+#include <ali/unit_enabler.hpp>
+#include "check.hpp"
+#include <fstream>
+#include <unistd.h>
+
+
+static const fs::path UnitDir {"usr/lib/systemd/system"};
+static const fs::path WantsDir {"etc/systemd/system/multi-user.target.wants"};
+
+
+static void write_unit(const fs::path& root, const std::string_view name, const std::string_view content)
+{
+  fs::create_directories(root / UnitDir);
+  std::ofstream{root / UnitDir / name} << content;
+}
+
+
+int main()
+{
+  const fs::path root {fs::temp_directory_path() / std::format("ali-unit-enabler-{}", ::getpid())};
+  fs::remove_all(root);
+
+  // systemd permits spaces around '='
+  write_unit(root, "spaced.service", "[Unit]\nDescription = Spaced\n\n[Install]\nWantedBy = multi-user.target\n");
+  write_unit(root, "plain.service", "[Install]\nWantedBy=multi-user.target\n");
+  write_unit(root, "static.service", "[Unit]\nDescription=No install section\n");
+
+  UnitEnabler enabler{root};
+
+  CHECK(enabler.enable("spaced.service"));
+  CHECK(fs::is_symlink(root / WantsDir / "spaced.service"));
+  std::error_code ec;
+  CHECK(fs::read_symlink(root / WantsDir / "spaced.service", ec) == "/" / UnitDir / "spaced.service");
+
+  CHECK(enabler.enable("plain.service"));
+  CHECK(fs::is_symlink(root / WantsDir / "plain.service"));
+
+  // static: nothing to enable, not an error
+  CHECK(enabler.enable("static.service"));
+  CHECK(!fs::exists(root / WantsDir / "static.service"));
+
+  CHECK(!enabler.enable("missing.service"));
+
+  fs::remove_all(root);
+  return failures == 0 ? 0 : 1;
+}